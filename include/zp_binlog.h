@@ -26,6 +26,30 @@ std::string NewFileName(const std::string& name, uint32_t current);
 // Find the nearest block start offset
 uint64_t BinlogBlockStart(uint64_t offset);
 
+// Stamp given by master to each binlog item, kept as it is by slaves
+struct BinlogStamp {
+  uint64_t seq;  // 0 means not stamped
+  uint64_t time_us;
+  BinlogStamp()
+    : seq(0), time_us(0) {}
+  BinlogStamp(uint64_t s, uint64_t t)
+    : seq(s), time_us(t) {}
+};
+
+// Item without stamp is written as content only, otherwise flags are
+// kept in item, content is snappy compressed if kBinlogItemSnappy
+// is asked and worthwhile
+void EncodeBinlogItem(const BinlogStamp& stamp, const Slice& content,
+    int flags, std::string* item);
+// Return payload of item, stamp is left zero if not stamped,
+// payload is compressed if flags has kBinlogItemSnappy
+Slice DecodeBinlogItem(const Slice& item, BinlogStamp* stamp,
+    int* flags = NULL);
+// Uncompressed content of item, kept in scratch if needed,
+// return false if item is broken
+bool GetBinlogItemContent(const Slice& item, BinlogStamp* stamp,
+    std::string* scratch, Slice* content);
+
 enum RecordType {
   kZeroType = 0,
   kFullType = 1,
@@ -35,7 +59,12 @@ enum RecordType {
   kEof = 5,
   kBadRecord = 6,
   kEmptyType = 7,
+  kBadChecksum = 8,
 };
+// Set in type of record with checksum, which is written for stamped items
+const int kRecordCrcFlag = 0x10;
+// Item could be given in parts, which are written without joining
+const int kBinlogMaxParts = 4;
 
 /**
  * Version
@@ -53,6 +82,11 @@ class Version {
   void Save(uint32_t num, uint64_t offset);
   void Fetch(uint32_t *num, uint64_t *offset);
   void Inc(uint64_t go_head);
+  void Inc(uint64_t go_head, const BinlogStamp& stamp);
+  BinlogStamp stamp() {
+    slash::RWLock l(&rwlock_, false);
+    return stamp_;
+  }
 
   void Debug();
 
@@ -61,6 +95,7 @@ class Version {
   pthread_rwlock_t rwlock_;
   uint32_t pro_num_;
   uint64_t pro_offset_;
+  BinlogStamp stamp_;  // of the last item
 
   slash::RWFile *save_;
 
@@ -83,14 +118,21 @@ public:
   BinlogWriter(slash::WritableFile *queue);
   ~BinlogWriter(); 
   Status Fallback(uint64_t offset);
-  Status Produce(const Slice &item, int64_t *write_size);
+  // Records are checksummed only if asked, so that a plain binlog of an
+  // old master is kept byte by byte on slave
+  Status Produce(const Slice &item, bool checksum, int64_t *write_size) {
+    return Produce(&item, 1, checksum, write_size);
+  }
+  Status Produce(const Slice *parts, int num, bool checksum,
+      int64_t *write_size);
   Status AppendBlank(uint64_t len, int64_t* write_size);
 
 private:
   slash::WritableFile *queue_;
   int block_offset_;
-  Status EmitPhysicalRecord(RecordType t,
-      const char *ptr, size_t n, int64_t *write_size);
+  // Record content is n bytes from pieces
+  Status EmitPhysicalRecord(RecordType t, bool checksum,
+      const Slice *pieces, int num, size_t n, int64_t *write_size);
   void Load();
 
   // No copying allowed
@@ -107,17 +149,36 @@ class BinlogReader {
 public:
   BinlogReader(slash::SequentialFile *queue);
   ~BinlogReader(); 
+  // Reader on the read-only mapping of a rolled binlog file,
+  // which returns records without copy.
+  // Cold file is read only once, its pages are dropped behind the cursor
+  static Status CreateMapped(const std::string& path, bool cold,
+      BinlogReader** rptr);
   Status Seek(uint64_t offset);
   Status Consume(uint64_t *size, std::string *item);
+  // item points into the mapping or the read buffer, and to scratch
+  // only for record of several fragments. Valid until the next call
+  Status Consume(uint64_t *size, std::string *scratch, Slice *item);
   void SkipNextBlock(uint64_t* size);
 
 private:
+  BinlogReader(int fd, const char* map, uint64_t map_size, bool cold);
   slash::SequentialFile *queue_;
+  // Mapped file, NULL if read from queue_
+  int fd_;
+  const char* map_;
+  uint64_t map_size_;
+  uint64_t map_pos_;
+  bool cold_;
+  uint64_t dropped_offset_;  // page cache before it has been dropped
   char* const backing_store_;
   slash::Slice buffer_;
   int last_record_offset_;
   bool last_error_happened_;
   uint32_t ReadPhysicalRecord(uint64_t *size, slash::Slice *result);
+  Status Read(size_t n, slash::Slice *result);
+  void Skip(uint64_t n);
+  void MaybeDropCache();
 
   // No copying allowed
   BinlogReader(const BinlogReader&);
@@ -144,12 +205,36 @@ public:
     return filename_;
   }
 
-  Status Put(const std::string &item);
+  // Stamp item with next seq and current time if asked, as master,
+  // also return the producer offset right after item. Unstamped item
+  // is written as content only without checksum, the same as old
+  // versions, and flags are ignored since there is no header for them
+  Status Put(const std::string &item, bool stamp, int flags,
+      uint32_t* filenum, uint64_t* offset) {
+    Slice content(item.data(), item.size());
+    return Put(&content, 1, stamp, flags, filenum, offset);
+  }
+  // Content is given in parts, written without copy if not compressed
+  Status Put(const Slice *parts, int num, bool stamp, int flags,
+      uint32_t* filenum, uint64_t* offset);
+  // Keep stamp from master, as slave
+  Status Put(const std::string &item, const BinlogStamp& stamp);
+  // Keep item encoded by master as it is, as slave
+  Status PutItem(const std::string &item);
   Status PutBlank(uint64_t len);
-
-  void GetProducerStatus(uint32_t* filenum, uint64_t* pro_offset) {
+  // Create and preallocate the next file once current one is half
+  // full, so that roll only renames it. Called by one thread only
+  void PrepareNext();
+  // Start writeback of what is written since last time
+  void SyncRange();
+
+  void GetProducerStatus(uint32_t* filenum, uint64_t* pro_offset,
+      BinlogStamp* stamp = NULL) {
     slash::MutexLock l(&mutex_);
     version_->Fetch(filenum, pro_offset);
+    if (stamp != NULL) {
+      *stamp = version_->stamp();
+    }
   }
   Status SetProducerStatus(uint32_t pro_num, uint64_t pro_offset,
       uint64_t* actual_offset, uint32_t* cur_num, uint64_t* cur_offset,
@@ -166,7 +251,17 @@ private:
   slash::WritableFile *queue_;
   BinlogWriter* writer_;
 
+  // Another fd of current file for sync_file_range
+  int sync_fd_;
+  uint64_t synced_offset_;
+  void ResetSyncFd(int fd, uint64_t offset);
+
+  // Prepared next file, NULL if not yet
+  slash::WritableFile *next_queue_;
+  int next_sync_fd_;
+
   Status Init();
+  Status Produce(const BinlogStamp& stamp, const Slice *parts, int num);
   void MaybeRoll();
   Status RemoveBetween(int lbound, int rbound);
   
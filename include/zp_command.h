@@ -55,6 +55,8 @@ enum CmdType {
   kSyncCmd,
   kMgetCmd,
   kFlushDBCmd,
+  kWaitCmd,
+  kConfigCmd,
   // Meta related
   kPingCmd,
   kPullCmd,
@@ -70,6 +72,7 @@ enum CmdType {
   kMigrateCmd,
   kCancelMigrateCmd,
   kRemoveNodesCmd,
+  kSetQuotaCmd,
 };
 
 class Cmd {
@@ -84,6 +87,14 @@ class Cmd {
       std::string* log_raw) const {
     return request->SerializeToString(log_raw);
   }
+  // Instead of GenerateLog, the request bytes as received could be
+  // logged with patch appended, which is merged into request on parse.
+  // Return false if the request has to be rewritten
+  virtual bool GenerateLogPatch(const google::protobuf::Message *request,
+      std::string* patch) const {
+    patch->clear();
+    return true;
+  }
   virtual std::string name() const = 0;
   virtual std::string ExtractTable(const google::protobuf::Message *request) const {
     return "";
@@ -120,6 +131,11 @@ class Cmd {
     return ((flag_ & kCmdFlagsMaskRedirect) == kCmdFlagsRedirect);
   }
 
+  // Executed ahead of others when queued
+  bool is_prior() const {
+    return ((flag_ & kCmdFlagsMaskPrior) == kCmdFlagsPrior);
+  }
+
  private:
   uint16_t flag_;
 
@@ -1,16 +1,78 @@
 #ifndef INCLUDE_ZP_CONF_H_
 #define INCLUDE_ZP_CONF_H_
 
+#include <deque>
+#include <atomic>
 #include <string>
 #include <vector>
+#include <utility>
 
 #include "include/zp_const.h"
 
 #include "slash/include/slash_string.h"
 #include "slash/include/slash_mutex.h"
 
-typedef slash::RWLock RWLock;
+// All config items, never changed once published
+struct ZpConfItems {
+  // Env
+  std::vector<std::string> meta_addr;
+  std::string local_ip;
+  int local_port;
+  int64_t timeout;
+  std::string data_path;
+  std::string log_path;
+  std::string trash_path;
+  bool daemonize;
+  std::string pid_file;
+  std::string lock_file;
+  bool enable_data_delete;
+  bool enable_get_coalesce;
+
+  // Thread Num
+  int meta_thread_num;
+  int data_thread_num;
+  int data_exec_thread_num;
+  int sync_recv_thread_num;
+  int sync_send_thread_num;
+  int max_background_flushes;
+  int max_background_compactions;
+
+  // Binlog related
+  int binlog_remain_days;
+  int binlog_remain_min_count;
+  int binlog_remain_max_count;
+  bool binlog_stamp;
+  bool binlog_compression;
+  bool binlog_compact_record;
+
+  // DB
+  int db_write_buffer_size; // KB
+  int db_max_write_buffer; // KB
+  int db_target_file_size_base; // KB
+  int db_max_open_files;
+  int db_block_size; //KB
+
+  // Feature
+  int slowlog_slower_than;
+  int slowlog_perf_sample_rate;  // db perf timers of one in this many
+  int stuck_offset_dist;
+  int slowdown_delay_radio;  // Percent
+  int row_cache_size;  // MB, 0 means disable
+  int trace_sample_rate;  // trace one in this many commands, 0 means disable
+  int metrics_port;  // http port for prometheus, 0 means disable
 
+  // Floyd options
+  int floyd_check_leader_us;
+  int floyd_heartbeat_us;
+  int floyd_append_entries_size_once;
+  int floyd_append_entries_count_once;
+
+  ZpConfItems();
+};
+
+// Readers get items from the current snapshot without any lock,
+// writers copy it, change and publish a new one.
+// Only hot items could be changed after Load, by Set or Reload
 class ZpConf {
  public:
   ZpConf();
@@ -19,196 +81,167 @@ class ZpConf {
   void Dump() const;
 
   int Load(const std::string& path);
+  // Reload hot items from the file loaded before
+  int Reload();
+  // Return false if name is not a hot item or value is invalid
+  bool Set(const std::string& name, const std::string& value,
+      std::string* msg);
+  // Items whose name match the glob style pattern
+  void Get(const std::string& pattern,
+      std::vector<std::pair<std::string, std::string>>* items) const;
 
-  std::string local_ip() {
-    RWLock l(&rwlock_, false);
-    return local_ip_;
+  std::string local_ip() const {
+    return items()->local_ip;
   }
 
-  int local_port() {
-    RWLock l(&rwlock_, false);
-    return local_port_;
+  int local_port() const {
+    return items()->local_port;
   }
 
-  int64_t timeout() {
-    RWLock l(&rwlock_, false);
-    return timeout_;
+  int64_t timeout() const {
+    return items()->timeout;
   }
 
-  std::string data_path() {
-    RWLock l(&rwlock_, false);
-    return data_path_;
+  std::string data_path() const {
+    return items()->data_path;
   }
 
-  std::string log_path() {
-    RWLock l(&rwlock_, false);
-    return log_path_;
+  std::string log_path() const {
+    return items()->log_path;
   }
 
-  std::string trash_path() {
-    RWLock l(&rwlock_, false);
-    return trash_path_;
+  std::string trash_path() const {
+    return items()->trash_path;
   }
 
-  bool daemonize() {
-    RWLock l(&rwlock_, false);
-    return daemonize_;
+  bool daemonize() const {
+    return items()->daemonize;
   }
 
-  std::string pid_file() {
-    RWLock l(&rwlock_, false);
-    return pid_file_;
+  std::string pid_file() const {
+    return items()->pid_file;
   }
 
-  std::string lock_file() {
-    RWLock l(&rwlock_, false);
-    return lock_file_;
+  std::string lock_file() const {
+    return items()->lock_file;
   }
 
-  bool enable_data_delete() {
-    RWLock l(&rwlock_, false);
-    return enable_data_delete_;
+  bool enable_data_delete() const {
+    return items()->enable_data_delete;
   }
 
-  std::vector<std::string>& meta_addr() {
-    RWLock l(&rwlock_, false);
-    return meta_addr_;
+  bool enable_get_coalesce() const {
+    return items()->enable_get_coalesce;
   }
 
-  int meta_thread_num() {
-    RWLock l(&rwlock_, false);
-    return meta_thread_num_;
+  std::vector<std::string> meta_addr() const {
+    return items()->meta_addr;
+  }
+
+  int meta_thread_num() const {
+    return items()->meta_thread_num;
+  }
+  int data_thread_num() const {
+    return items()->data_thread_num;
+  }
+  int data_exec_thread_num() const {
+    return items()->data_exec_thread_num;
+  }
+  int sync_recv_thread_num() const {
+    return items()->sync_recv_thread_num;
   }
-  int data_thread_num() {
-    RWLock l(&rwlock_, false);
-    return data_thread_num_;
+  int sync_send_thread_num() const {
+    return items()->sync_send_thread_num;
   }
-  int sync_recv_thread_num() {
-    RWLock l(&rwlock_, false);
-    return sync_recv_thread_num_;
+  int max_background_flushes() const {
+    return items()->max_background_flushes;
   }
-  int sync_send_thread_num() {
-    RWLock l(&rwlock_, false);
-    return sync_send_thread_num_;
+  int max_background_compactions() const {
+    return items()->max_background_compactions;
   }
-  int max_background_flushes() {
-    RWLock l(&rwlock_, false);
-    return max_background_flushes_;
+  int binlog_remain_days() const {
+    return items()->binlog_remain_days;
   }
-  int max_background_compactions() {
-    RWLock l(&rwlock_, false);
-    return max_background_compactions_;
+  int binlog_remain_min_count() const {
+    return items()->binlog_remain_min_count;
   }
-  int binlog_remain_days() {
-    RWLock l(&rwlock_, false);
-    return binlog_remain_days_;
+  int binlog_remain_max_count() const {
+    return items()->binlog_remain_max_count;
   }
-  int binlog_remain_min_count() {
-    RWLock l(&rwlock_, false);
-    return binlog_remain_min_count_;
+  bool binlog_stamp() const {
+    return items()->binlog_stamp;
   }
-  int binlog_remain_max_count() {
-    RWLock l(&rwlock_, false);
-    return binlog_remain_max_count_;
+  bool binlog_compression() const {
+    return items()->binlog_compression;
   }
-  int slowlog_slower_than() {
-    RWLock l(&rwlock_, false);
-    return slowlog_slower_than_;
+  bool binlog_compact_record() const {
+    return items()->binlog_compact_record;
   }
-  int stuck_offset_dist() {
-    RWLock l(&rwlock_, false);
-    return stuck_offset_dist_;
+  int slowlog_slower_than() const {
+    return items()->slowlog_slower_than;
   }
-  int slowdown_delay_radio() {
-    RWLock l(&rwlock_, false);
-    return slowdown_delay_radio_;
+  int slowlog_perf_sample_rate() const {
+    return items()->slowlog_perf_sample_rate;
   }
-  int db_write_buffer_size() {
-    RWLock l(&rwlock_, false);
-    return db_write_buffer_size_;
+  int stuck_offset_dist() const {
+    return items()->stuck_offset_dist;
   }
-  int db_max_write_buffer() {
-    RWLock l(&rwlock_, false);
-    return db_max_write_buffer_;
+  int slowdown_delay_radio() const {
+    return items()->slowdown_delay_radio;
   }
-  int db_target_file_size_base() {
-    RWLock l(&rwlock_, false);
-    return db_target_file_size_base_;
+  int row_cache_size() const {
+    return items()->row_cache_size;
   }
-  int db_max_open_files() {
-    RWLock l(&rwlock_, false);
-    return db_max_open_files_;
+  int trace_sample_rate() const {
+    return items()->trace_sample_rate;
   }
-  int db_block_size() {
-    RWLock l(&rwlock_, false);
-    return db_block_size_;
+  int metrics_port() const {
+    return items()->metrics_port;
   }
-  int floyd_check_leader_us() {
-    RWLock l(&rwlock_, false);
-    return floyd_check_leader_us_;
+  int db_write_buffer_size() const {
+    return items()->db_write_buffer_size;
+  }
+  int db_max_write_buffer() const {
+    return items()->db_max_write_buffer;
+  }
+  int db_target_file_size_base() const {
+    return items()->db_target_file_size_base;
+  }
+  int db_max_open_files() const {
+    return items()->db_max_open_files;
+  }
+  int db_block_size() const {
+    return items()->db_block_size;
+  }
+  int floyd_check_leader_us() const {
+    return items()->floyd_check_leader_us;
   }
 
-  int floyd_heartbeat_us() {
-    RWLock l(&rwlock_, false);
-    return floyd_heartbeat_us_;
+  int floyd_heartbeat_us() const {
+    return items()->floyd_heartbeat_us;
   }
 
-  int floyd_append_entries_size_once() {
-    RWLock l(&rwlock_, false);
-    return floyd_append_entries_size_once_;
+  int floyd_append_entries_size_once() const {
+    return items()->floyd_append_entries_size_once;
   }
-  int floyd_append_entries_count_once() {
-    RWLock l(&rwlock_, false);
-    return floyd_append_entries_count_once_;
+  int floyd_append_entries_count_once() const {
+    return items()->floyd_append_entries_count_once;
   }
 
  private:
-
-  // Env
-  std::vector<std::string> meta_addr_;
-  std::string local_ip_;
-  int local_port_;
-  int64_t timeout_;
-  std::string data_path_;
-  std::string log_path_;
-  std::string trash_path_;
-  bool daemonize_;
-  std::string pid_file_;
-  std::string lock_file_;
-  bool enable_data_delete_;
-
-  // Thread Num
-  int meta_thread_num_;
-  int data_thread_num_;
-  int sync_recv_thread_num_;
-  int sync_send_thread_num_;
-  int max_background_flushes_;
-  int max_background_compactions_;
-
-  // Binlog related
-  int binlog_remain_days_;
-  int binlog_remain_min_count_;
-  int binlog_remain_max_count_;
-
-  // DB
-  int db_write_buffer_size_; // KB
-  int db_max_write_buffer_; // KB
-  int db_target_file_size_base_; // KB
-  int db_max_open_files_; 
-  int db_block_size_; //KB
-
-  // Feature
-  int slowlog_slower_than_;
-  int stuck_offset_dist_;
-  int slowdown_delay_radio_;  // Percent
-
-  // Floyd options
-  int floyd_check_leader_us_;
-  int floyd_heartbeat_us_;
-  int floyd_append_entries_size_once_;
-  int floyd_append_entries_count_once_;
-
-  pthread_rwlock_t rwlock_;
+  std::atomic<const ZpConfItems*> items_;
+  const ZpConfItems* items() const {
+    return items_.load(std::memory_order_acquire);
+  }
+
+  // Protect writers below
+  slash::Mutex mu_;
+  std::string path_;
+  // Replaced snapshots with when they are replaced. Readers hold no lock,
+  // but never keep a snapshot for long, so these are freed after
+  // kConfRetireGrace
+  std::deque<std::pair<uint64_t, const ZpConfItems*>> retired_;
+  void Publish(ZpConfItems* items);
 
   // copy disallowded
   ZpConf(const ZpConf& options);
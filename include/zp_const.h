@@ -24,9 +24,29 @@ const size_t kBlockSize = 64 * 1024;
 const uint64_t kBinlogSize = 1024 * 1024 * 100;
 // Header is Type(1 byte), length (2 bytes)
 const size_t kHeaderSize = 1 + 3;
+// Header of record with checksum is followed by
+// Crc32c(4 bytes) of type and content
+const size_t kCrcHeaderSize = kHeaderSize + 4;
 const std::string kBinlogPrefix = "binlog";
 const size_t kBinlogPrefixLen = 6;
 const std::string kManifest = "manifest";
+// Next binlog file, created and preallocated ahead of roll
+const std::string kBinlogPrepared = "prepared_binlog";
+// Start writeback of binlog from cron once this many bytes are written
+const uint64_t kBinlogSyncRangeSize = 1024 * 1024;
+// Cold binlog is read ahead and dropped from page cache by this many bytes
+const uint64_t kBinlogColdWindow = 4 * 1024 * 1024;
+// Item header is Magic(1 byte), Version(1 byte), Seq(8 bytes), Time(8 bytes),
+// magic never begins a serialized CmdRequest, which is left by old version
+const char kBinlogItemMagic = '\xbf';
+const char kBinlogItemVersion = 1;
+const size_t kBinlogItemHeaderSize = 1 + 1 + 8 + 8;
+// Flags share the version byte, in the high 4 bits
+const int kBinlogItemVersionMask = 0x0f;
+const int kBinlogItemSnappy = 0x10;  // content is snappy compressed
+const int kBinlogItemCompact = 0x20;  // content is compact binlog record
+// Smaller content is never compressed
+const size_t kBinlogCompressMinSize = 256;
 
 /* DBSync related */
 const uint32_t kDBSyncMaxGap = 1000;
@@ -57,6 +77,9 @@ const int kBinlogDefaultLease = 20;
 const int kBinlogTimeSlice = 5;    // should larger than kBinlogSendInterval
 const int kBinlogReceiverCronInterval = 6000;
 const int kBinlogReceiveBgWorkerFull = 100;
+const int kBinlogAckDelay = 5;  // mili seconds, acks within it are merged
+const int kBinlogAckRetryDelay = 1000;  // mili seconds, after ack failed
+const int kWaitMaxTimeout = 5000;  // mili seconds, for WAIT command
 
 /* Heartbeat related */
 const int kPingInterval = 5;
@@ -72,6 +95,11 @@ const int kDispatchQueueSize = 1000;
 const int kMetaDispathCronInterval = 1000;
 const int kMetaDispathQueueSize = 1000;
 const int kKeepAlive = 60;  // seconds
+const int kExecIdleWait = 100;  // mili seconds
+const size_t kExecReplyMaxPending = 64 * 1024 * 1024;  // unsent reply bytes
+const int kExecStarveTime = 50;  // mili seconds, normal task waits at most
+const size_t kClientReadOnce = 1024 * 1024;  // most bytes read one time
+const size_t kClientMaxFrame = 64 * 1024 * 1024;
 const int kMetacmdInterval = 6;
 
 /* Server cron related */
@@ -87,6 +115,44 @@ const int kMetaLeaderTimeout = 60;
 const int kMetaLeaderRemainThreshold = 10; // Should large than kMetaCronInterval * kMetaCronWaitCount
 
 const int kMetaOffsetStuckDist =  1024 * 100;  // when begin to stuck parititon, should small than kBinlogSize
-const int kSlowdownDelayRatio = 60;  // Percent of write request to delay
+// Percent of slave catch up speed kept to narrow the gap in slowdown,
+// writes go with the left
+const int kSlowdownDelayRatio = 60;
+const uint64_t kSlowdownMinRate = 1024 * 1024;  // bytes per second
+const int kSlowdownMaxDelay = 500;  // mili seconds
+const int kSlowdownQueueSize = 1000;  // most writes delayed together
+
+/* Write stall related */
+const int kStallCheckInterval = 100;  // mili seconds
+const int kStallMaxWriters = 4;  // most writes in db together when delayed
+const int kStallRetryDelay = 100;  // mili seconds, suggested to client
+
+/* Slowlog related */
+const size_t kSlowlogMaxLen = 128;  // entries kept at most
+const size_t kSlowlogKeyLen = 32;  // key prefix kept in entry
+
+/* Trace related */
+const std::string kTraceFile = "trace.json";  // under log path
+const int kTraceFlushInterval = 1000;  // mili seconds
+const size_t kTraceMaxPending = 10000;  // traces not written yet
+
+/* Metrics related */
+const int kMetricsTimeout = 1000;  // mili seconds for one request
+// Upper bound of each latency bucket in micro seconds
+const uint64_t kLatencyBuckets[] = {
+  100, 250, 500, 1000, 2500, 5000, 10000, 25000,
+  50000, 100000, 250000, 500000, 1000000
+};
+const int kLatencyBucketNum = 13;
+
+/* Config related */
+// Replaced config snapshots are freed after this, when no reader could
+// be still on them
+const int kConfRetireGrace = 60;  // seconds
+
+/* Async log related */
+const int kLogRingSize = 8192;  // lines queued at most, should be power of 2
+const int kLogFlushInterval = 10;  // mili seconds
+const int kLogLimitInterval = 1000;  // mili seconds between limited lines
 
 #endif  // INCLUDE_ZP_CONST_H_
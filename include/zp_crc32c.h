@@ -0,0 +1,15 @@
+#ifndef INCLUDE_ZP_CRC32C_H_
+#define INCLUDE_ZP_CRC32C_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+// CRC32C (Castagnoli), by SSE4.2 crc32 instruction when built with it,
+// crc is the value of data before, so a checksum could be extended
+uint32_t ZPCrc32cExtend(uint32_t crc, const char* data, size_t n);
+
+inline uint32_t ZPCrc32c(const char* data, size_t n) {
+  return ZPCrc32cExtend(0, data, n);
+}
+
+#endif  // INCLUDE_ZP_CRC32C_H_
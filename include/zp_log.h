@@ -0,0 +1,111 @@
+#ifndef INCLUDE_ZP_LOG_H_
+#define INCLUDE_ZP_LOG_H_
+
+#include <time.h>
+#include <atomic>
+#include <string>
+#include <vector>
+#include <glog/logging.h>
+
+#include "pink/include/pink_thread.h"
+#include "slash/include/slash_mutex.h"
+
+// Replace glog's file loggers with async ones after InitGoogleLogging,
+// and make them synchronous again before ShutdownGoogleLogging
+void ZPLogInit();
+void ZPLogShutdown();
+
+// Wrap a glog file logger. glog still calls Write under its own global
+// mutex, but only a copy into the ring is done there, file writes and
+// flushes are done by a background thread instead.
+// Lines are dropped and counted when the ring is full, except FATAL ones,
+// which are written through together with all queued before.
+// Newer glog deletes the logger set once replaced or at shutdown, so it's
+// never replaced back or deleted by us, but turned synchronous by Stop.
+class ZPAsyncLogger : public google::base::Logger {
+ public:
+  explicit ZPAsyncLogger(google::base::Logger* wrapped);
+  virtual ~ZPAsyncLogger();
+
+  virtual void Write(bool force_flush, time_t timestamp,
+      const char* message, int message_len);
+  virtual void Flush();
+  virtual google::uint32 LogSize();
+
+  bool Start();
+  // Write all queued lines, and every line later directly
+  void Stop();
+  // Write all queued lines to the wrapped logger
+  bool Drain();
+
+ private:
+  struct Slot {
+    std::atomic<uint64_t> seq;
+    bool force_flush;
+    time_t timestamp;
+    std::string message;
+  };
+
+  class FlushThread : public pink::Thread {
+   public:
+    explicit FlushThread(ZPAsyncLogger* logger)
+      : logger_(logger) {
+        set_thread_name("ZPLogFlush");
+      }
+    virtual ~FlushThread() {
+      StopThread();
+    }
+
+   private:
+    ZPAsyncLogger* logger_;
+    virtual void* ThreadMain();
+  };
+
+  google::base::Logger* wrapped_;
+  std::vector<Slot> slots_;
+  std::atomic<uint64_t> tail_;  // next to write
+  std::atomic<uint64_t> dropped_;
+  std::atomic<bool> sync_;
+  void WriteThrough(bool force_flush, time_t timestamp,
+      const char* message, int message_len);
+
+  // Protect consumer side below
+  slash::Mutex drain_mu_;
+  uint64_t head_;  // next to read
+  FlushThread* flush_thread_;
+  bool DrainLocked();
+
+  ZPAsyncLogger(const ZPAsyncLogger&);
+  void operator=(const ZPAsyncLogger&);
+};
+
+// At most one line every kLogLimitInterval for one call site
+class ZPLogLimiter {
+ public:
+  ZPLogLimiter()
+    : last_us_(0), suppressed_(0) {}
+  // Return 1 if allowed, with the number suppressed since last one
+  uint64_t Allow(uint64_t* suppressed);
+
+ private:
+  std::atomic<uint64_t> last_us_;
+  std::atomic<uint64_t> suppressed_;
+};
+
+struct ZPLogSuppressed {
+  uint64_t num;
+};
+std::ostream& operator<<(std::ostream& os, const ZPLogSuppressed& s);
+
+// Usage: LOG_LIMITED(WARNING) << "something";
+// which is prefixed by "[N suppressed] " if any line is dropped before
+#define LOG_LIMITED(severity) \
+  for (uint64_t zp_log_suppressed = 0, zp_log_allowed = \
+        ([]() -> ZPLogLimiter* { \
+          static ZPLogLimiter limiter; \
+          return &limiter; \
+        })()->Allow(&zp_log_suppressed); \
+      zp_log_allowed; zp_log_allowed = 0) \
+    LOG(severity) << ZPLogSuppressed{zp_log_suppressed}
+
+#endif  // INCLUDE_ZP_LOG_H_
@@ -0,0 +1,60 @@
+#ifndef INCLUDE_ZP_METRICS_H_
+#define INCLUDE_ZP_METRICS_H_
+
+#include <string>
+#include <vector>
+#include <utility>
+#include <functional>
+#include <unordered_map>
+
+#include "pink/include/pink_thread.h"
+#include "slash/include/slash_status.h"
+
+// Metrics in prometheus text format.
+// Samples of one metric are grouped together whatever the order added.
+class ZPMetrics {
+ public:
+  typedef std::vector<std::pair<std::string, std::string>> Labels;
+
+  void Declare(const std::string& name, const std::string& type,
+      const std::string& help);
+  void Add(const std::string& name, const Labels& labels, double value);
+  // counts[i] is the number no larger than bounds[i], not cumulative,
+  // and counts[num] is the number larger than all bounds
+  void AddHistogram(const std::string& name, const Labels& labels,
+      const uint64_t* bounds, const uint64_t* counts, int num, double sum);
+
+  void Render(std::string* out) const;
+
+ private:
+  struct Family {
+    std::string type;
+    std::string help;
+    std::string samples;
+  };
+  std::vector<std::string> names_;
+  std::unordered_map<std::string, Family> families_;
+  Family* GetFamily(const std::string& name);
+  static void AppendSample(const std::string& name, const Labels& labels,
+      double value, std::string* out);
+};
+
+// Serve GET /metrics over http, one connection at a time,
+// metrics are collected on each request
+class ZPMetricsServer : public pink::Thread {
+ public:
+  ZPMetricsServer(int port, const std::function<void(ZPMetrics*)>& collect);
+  virtual ~ZPMetricsServer();
+
+  slash::Status Start();
+
+ private:
+  int port_;
+  int listen_fd_;
+  std::function<void(ZPMetrics*)> collect_;
+
+  virtual void* ThreadMain();
+  void HandleConn(int fd);
+};
+
+#endif  // INCLUDE_ZP_METRICS_H_
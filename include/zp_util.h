@@ -54,6 +54,15 @@ struct Statistic {
   size_t write_avg_latency;
   size_t write_min_latency;
 
+  uint64_t expired;  // commands dropped for deadline exceeded
+
+  // Latency histogram in us, bounded by kLatencyBuckets,
+  // the last one is for those larger than all
+  uint64_t read_latency_hist[kLatencyBucketNum + 1];
+  uint64_t write_latency_hist[kLatencyBucketNum + 1];
+  uint64_t read_latency_sum;
+  uint64_t write_latency_sum;
+
   Statistic();
   Statistic(const Statistic& stat);
 
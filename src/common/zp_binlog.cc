@@ -1,8 +1,19 @@
 #include "include/zp_binlog.h"
 
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <iostream>
 #include <string>
 #include <glog/logging.h>
+#include <snappy.h>
+
+#include "include/zp_crc32c.h"
+
+#include "slash/include/slash_coding.h"
 
 using slash::RWLock;
 
@@ -16,6 +27,76 @@ uint64_t BinlogBlockStart(uint64_t offset) {
   return ((offset / kBlockSize) * kBlockSize);
 }
 
+static void EncodeBinlogItemHeader(const BinlogStamp& stamp, int flags,
+    char* buf) {
+  buf[0] = kBinlogItemMagic;
+  buf[1] = static_cast<char>(kBinlogItemVersion
+      | (flags & ~kBinlogItemVersionMask));
+  slash::EncodeFixed64(buf + 2, stamp.seq);
+  slash::EncodeFixed64(buf + 10, stamp.time_us);
+}
+
+void EncodeBinlogItem(const BinlogStamp& stamp, const Slice& content,
+    int flags, std::string* item) {
+  item->clear();
+  if (stamp.seq == 0) {
+    item->assign(content.data(), content.size());
+    return;
+  }
+  std::string compressed;
+  if ((flags & kBinlogItemSnappy)
+      && content.size() >= kBinlogCompressMinSize) {
+    snappy::Compress(content.data(), content.size(), &compressed);
+    // Not worth it if less than 1/8 saved
+    if (compressed.size() > content.size() - content.size() / 8) {
+      compressed.clear();
+    }
+  }
+  if (compressed.empty()) {
+    flags &= ~kBinlogItemSnappy;
+  }
+  Slice payload = compressed.empty() ? content
+    : Slice(compressed.data(), compressed.size());
+
+  item->resize(kBinlogItemHeaderSize);
+  EncodeBinlogItemHeader(stamp, flags, &(*item)[0]);
+  item->append(payload.data(), payload.size());
+}
+
+Slice DecodeBinlogItem(const Slice& item, BinlogStamp* stamp, int* flags) {
+  *stamp = BinlogStamp();
+  if (flags != NULL) {
+    *flags = 0;
+  }
+  if (item.size() < kBinlogItemHeaderSize
+      || item.data()[0] != kBinlogItemMagic) {
+    return item;
+  }
+  if (flags != NULL) {
+    *flags = static_cast<unsigned char>(item.data()[1])
+      & ~kBinlogItemVersionMask;
+  }
+  const char* p = item.data() + 2;
+  stamp->seq = slash::DecodeFixed64(p);
+  stamp->time_us = slash::DecodeFixed64(p + 8);
+  return Slice(item.data() + kBinlogItemHeaderSize,
+      item.size() - kBinlogItemHeaderSize);
+}
+
+bool GetBinlogItemContent(const Slice& item, BinlogStamp* stamp,
+    std::string* scratch, Slice* content) {
+  int flags = 0;
+  *content = DecodeBinlogItem(item, stamp, &flags);
+  if (!(flags & kBinlogItemSnappy)) {
+    return true;
+  }
+  if (!snappy::Uncompress(content->data(), content->size(), scratch)) {
+    return false;
+  }
+  *content = Slice(scratch->data(), scratch->size());
+  return true;
+}
+
 /*
  * Version
  */
@@ -52,11 +133,22 @@ inline void Version::Inc(uint64_t go_head) {
   StableSave();
 }
 
+void Version::Inc(uint64_t go_head, const BinlogStamp& stamp) {
+  slash::RWLock l(&rwlock_, true);
+  pro_offset_ += go_head;
+  stamp_ = stamp;
+  StableSave();
+}
+
 Status Version::StableLoad() {
   Status s;
   if (save_->GetData() != NULL) {
     memcpy((char*)(&pro_num_), save_->GetData(), sizeof(uint32_t));
     memcpy((char*)(&pro_offset_), save_->GetData() + sizeof(uint32_t), sizeof(uint64_t));
+    // Zero in manifest of old version
+    const char* p = save_->GetData() + sizeof(uint32_t) + sizeof(uint64_t);
+    memcpy((char*)(&stamp_.seq), p, sizeof(uint64_t));
+    memcpy((char*)(&stamp_.time_us), p + sizeof(uint64_t), sizeof(uint64_t));
     DLOG(INFO) << "Load Binlog Version pro_num"<< pro_num_ << " pro_offset " << pro_offset_;;
     return Status::OK();
   } else {
@@ -69,6 +161,10 @@ void Version::StableSave() {
   memcpy(p, &pro_num_, sizeof(uint32_t));
   p += sizeof(uint32_t);
   memcpy(p, &pro_offset_, sizeof(uint64_t));
+  p += sizeof(uint64_t);
+  memcpy(p, &stamp_.seq, sizeof(uint64_t));
+  p += sizeof(uint64_t);
+  memcpy(p, &stamp_.time_us, sizeof(uint64_t));
   DLOG(INFO) << "Save to Version pro_num "<< pro_num_ << " pro_offset " << pro_offset_;;
 }
 
@@ -109,25 +205,34 @@ Status BinlogWriter::Fallback(uint64_t offset) {
   return s;
 }
  
-Status BinlogWriter::Produce(const Slice &item, int64_t *write_size) {
+Status BinlogWriter::Produce(const Slice *parts, int num, bool checksum,
+    int64_t *write_size) {
+  assert(num <= kBinlogMaxParts);
+  const size_t header_size = checksum ? kCrcHeaderSize : kHeaderSize;
   Status s;
-  const char *ptr = item.data();
-  size_t left = item.size();
+  size_t left = 0;
+  for (int i = 0; i < num; i++) {
+    left += parts[i].size();
+  }
+  // Next byte to write is at part_offset of parts[part]
+  int part = 0;
+  size_t part_offset = 0;
   bool begin = true;
 
   *write_size = 0;
   do {
     const int leftover = static_cast<int>(kBlockSize) - block_offset_;
     assert(leftover >= 0);
-    if (static_cast<size_t>(leftover) <= kHeaderSize) {
+    if (static_cast<size_t>(leftover) <= header_size) {
+      // Zero trailer, which is never taken as a record header
       if (leftover > 0) {
-        queue_->Append(Slice("\x00\x00\x00\x00\x00\x00\x00", leftover));
+        queue_->Append(Slice("\x00\x00\x00\x00\x00\x00\x00\x00", leftover));
         *write_size += leftover;
       }
       block_offset_ = 0;
     }
 
-    const size_t avail = kBlockSize - block_offset_ - kHeaderSize;
+    const size_t avail = kBlockSize - block_offset_ - header_size;
     const size_t fragment_length = (left < avail) ? left : avail;
     RecordType type;
     const bool end = (left == fragment_length);
@@ -141,37 +246,66 @@ Status BinlogWriter::Produce(const Slice &item, int64_t *write_size) {
       type = kMiddleType;
     }
 
-    s = EmitPhysicalRecord(type, ptr, fragment_length, write_size);
-    ptr += fragment_length;
+    Slice pieces[kBinlogMaxParts];
+    int piece_num = 0;
+    size_t need = fragment_length;
+    while (need > 0) {
+      size_t n = parts[part].size() - part_offset;
+      if (n > need) {
+        n = need;
+      }
+      if (n > 0) {
+        pieces[piece_num++] = Slice(parts[part].data() + part_offset, n);
+      }
+      need -= n;
+      part_offset += n;
+      if (part_offset == parts[part].size()) {
+        part++;
+        part_offset = 0;
+      }
+    }
+
+    s = EmitPhysicalRecord(type, checksum, pieces, piece_num,
+        fragment_length, write_size);
     left -= fragment_length;
     begin = false;
   } while (s.ok() && left > 0);
 
+  // Flush once for all fragments of the item
+  if (s.ok()) {
+    s = queue_->Flush();
+  }
   return s;
 }
 
-Status BinlogWriter::EmitPhysicalRecord(RecordType t, const char *ptr, size_t n, int64_t *write_size) {
+Status BinlogWriter::EmitPhysicalRecord(RecordType t, bool checksum,
+    const Slice *pieces, int num, size_t n, int64_t *write_size) {
     Status s;
+    const size_t header_size = checksum ? kCrcHeaderSize : kHeaderSize;
     assert(n <= 0xffffff);
-    assert(block_offset_ + kHeaderSize + n <= kBlockSize);
+    assert(block_offset_ + header_size + n <= kBlockSize);
 
-    char buf[kHeaderSize];
+    char buf[kCrcHeaderSize];
 
     buf[0] = static_cast<char>(n & 0xff);
     buf[1] = static_cast<char>((n & 0xff00) >> 8);
     buf[2] = static_cast<char>(n >> 16);
-    buf[3] = static_cast<char>(t);
+    buf[3] = static_cast<char>(checksum ? (t | kRecordCrcFlag) : t);
+    if (checksum) {
+      uint32_t crc = ZPCrc32c(buf + 3, 1);
+      for (int i = 0; i < num; i++) {
+        crc = ZPCrc32cExtend(crc, pieces[i].data(), pieces[i].size());
+      }
+      slash::EncodeFixed32(buf + kHeaderSize, crc);
+    }
 
-    s = queue_->Append(Slice(buf, kHeaderSize));
-    if (s.ok()) {
-        s = queue_->Append(Slice(ptr, n));
-        if (s.ok()) {
-            s = queue_->Flush();
-        }
+    s = queue_->Append(Slice(buf, header_size));
+    for (int i = 0; s.ok() && i < num; i++) {
+        s = queue_->Append(pieces[i]);
     }
-    block_offset_ += static_cast<int>(kHeaderSize + n);
+    block_offset_ += static_cast<int>(header_size + n);
 
-    *write_size += kHeaderSize + n;
+    *write_size += header_size + n;
     return s;
 }
 
@@ -199,10 +333,16 @@ Status BinlogWriter::AppendBlank(uint64_t len, int64_t* write_size) {
     const size_t avail = kBlockSize - block_offset_ - kHeaderSize;
     const size_t fragment_length = (left < avail) ? left : avail;
 
-    s = EmitPhysicalRecord(kEmptyType, tmp, fragment_length, write_size);
+    // Without checksum, so that the length is the same as before
+    Slice blank(tmp, fragment_length);
+    s = EmitPhysicalRecord(kEmptyType, false, &blank, 1, fragment_length,
+        write_size);
     left -= fragment_length;
   } while (s.ok() && left > 0);
 
+  if (s.ok()) {
+    s = queue_->Flush();
+  }
   return s;
 }
 
@@ -212,30 +352,145 @@ Status BinlogWriter::AppendBlank(uint64_t len, int64_t* write_size) {
  */
 BinlogReader::BinlogReader(slash::SequentialFile *queue)
   :queue_(queue),
+  fd_(-1),
+  map_(NULL),
+  map_size_(0),
+  map_pos_(0),
+  cold_(false),
+  dropped_offset_(0),
   backing_store_(new char[kBlockSize]),
   buffer_(),
   last_record_offset_(0) {
   }
 
+BinlogReader::BinlogReader(int fd, const char* map, uint64_t map_size,
+    bool cold)
+  :queue_(NULL),
+  fd_(fd),
+  map_(map),
+  map_size_(map_size),
+  map_pos_(0),
+  cold_(cold),
+  dropped_offset_(0),
+  backing_store_(NULL),
+  buffer_(),
+  last_record_offset_(0) {
+  }
+
 BinlogReader::~BinlogReader() {
   delete [] backing_store_;
+  if (map_ != NULL) {
+    munmap(const_cast<char*>(map_), map_size_);
+  }
+  if (fd_ >= 0) {
+    close(fd_);
+  }
+}
+
+Status BinlogReader::CreateMapped(const std::string& path, bool cold,
+    BinlogReader** rptr) {
+  *rptr = NULL;
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    return Status::IOError("Open binlog failed", strerror(errno));
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    close(fd);
+    return Status::IOError("Stat binlog failed", strerror(errno));
+  }
+  if (st.st_size == 0) {
+    // Nothing to map
+    close(fd);
+    return Status::InvalidArgument("Empty binlog", path);
+  }
+  void* map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  if (map == MAP_FAILED) {
+    close(fd);
+    return Status::IOError("Mmap binlog failed", strerror(errno));
+  }
+  madvise(map, st.st_size, MADV_SEQUENTIAL);
+  if (cold) {
+    posix_fadvise(fd, 0, st.st_size, POSIX_FADV_SEQUENTIAL);
+  }
+  *rptr = new BinlogReader(fd, static_cast<const char*>(map), st.st_size,
+      cold);
+  return Status::OK();
+}
+
+// Drop what has been read from page cache, so that hot data of
+// the db is not evicted, and read the next window ahead
+void BinlogReader::MaybeDropCache() {
+  if (!cold_ || map_pos_ < dropped_offset_ + kBinlogColdWindow) {
+    return;
+  }
+  static const uint64_t kPageSize = sysconf(_SC_PAGESIZE);
+  uint64_t end = map_pos_ / kPageSize * kPageSize;
+  // Unmap first, page cache still mapped is never dropped
+  madvise(const_cast<char*>(map_) + dropped_offset_, end - dropped_offset_,
+      MADV_DONTNEED);
+  posix_fadvise(fd_, dropped_offset_, end - dropped_offset_,
+      POSIX_FADV_DONTNEED);
+  dropped_offset_ = end;
+
+  uint64_t ahead = map_size_ - end;
+  if (ahead > 2 * kBinlogColdWindow) {
+    ahead = 2 * kBinlogColdWindow;
+  }
+  madvise(const_cast<char*>(map_) + end, ahead, MADV_WILLNEED);
+}
+
+// Same as SequentialFile, EndFile if less than n bytes left
+Status BinlogReader::Read(size_t n, slash::Slice *result) {
+  if (map_ == NULL) {
+    return queue_->Read(n, result, backing_store_);
+  }
+  size_t left = map_size_ - map_pos_;
+  if (n > left) {
+    *result = slash::Slice(map_ + map_pos_, left);
+    map_pos_ = map_size_;
+    return Status::EndFile("Eof");
+  }
+  *result = slash::Slice(map_ + map_pos_, n);
+  map_pos_ += n;
+  return Status::OK();
+}
+
+void BinlogReader::Skip(uint64_t n) {
+  if (map_ == NULL) {
+    queue_->Skip(n);
+    return;
+  }
+  map_pos_ = (n > map_size_ - map_pos_) ? map_size_ : map_pos_ + n;
 }
 
 void BinlogReader::SkipNextBlock(uint64_t* size) {
   int leftover = kBlockSize - last_record_offset_;
-  queue_->Skip(leftover);
+  Skip(leftover);
   *size += leftover;
   last_record_offset_ = 0;
 }
 
+Status BinlogReader::Consume(uint64_t* size, std::string* scratch) {
+  Slice item;
+  Status s = Consume(size, scratch, &item);
+  if (s.ok() && item.data() != scratch->data()) {
+    scratch->assign(item.data(), item.size());
+  }
+  return s;
+}
+
 // Comsume one record to scratch
 // size show how many byte moving forward
 // Return OK if success
 //        Incomplete: miss record begin or end
 //        EndFile
 //        IOError: data corruption or unknown type
-Status BinlogReader::Consume(uint64_t* size, std::string* scratch) {
+Status BinlogReader::Consume(uint64_t* size, std::string* scratch,
+    Slice* item) {
   assert(size != NULL);
+  // Item returned last time is not used any more
+  MaybeDropCache();
 
   Status s;
   bool inside_record = false;
@@ -248,7 +503,7 @@ Status BinlogReader::Consume(uint64_t* size, std::string* scratch) {
         if (inside_record) {
           return Status::Incomplete("Not found end item");
         }
-        *scratch = std::string(fragment.data(), fragment.size());
+        *item = fragment;
         return Status::OK();
       case kFirstType:
         if (inside_record) {
@@ -268,11 +523,14 @@ Status BinlogReader::Consume(uint64_t* size, std::string* scratch) {
           return Status::Incomplete("Not found first item");
         }
         scratch->append(fragment.data(), fragment.size());
+        *item = Slice(scratch->data(), scratch->size());
         return Status::OK();
       case kEof:
         return Status::EndFile("Eof");
       case kBadRecord:
         return Status::IOError("Data Corruption");
+      case kBadChecksum:
+        return Status::Corruption("Checksum mismatch");
       case kEmptyType:
         return Status::Incomplete("Not found whole item");
       default:
@@ -287,16 +545,22 @@ Status BinlogReader::Consume(uint64_t* size, std::string* scratch) {
 // Seek to a offset larger than the filesize will return Status::EOF
 Status BinlogReader::Seek(uint64_t offset) {
   uint64_t start_block = BinlogBlockStart(offset);
-  Status s = queue_->Skip(start_block);
-  if (!s.ok()) {
-    return s;
+  Status s;
+  if (map_ == NULL) {
+    s = queue_->Skip(start_block);
+    if (!s.ok()) {
+      return s;
+    }
+  } else {
+    Skip(start_block);
   }
   int64_t block_offset = offset % kBlockSize;
 
   while (block_offset > 0) {
     uint64_t size = 0;
     std::string tmp;
-    s = Consume(&size, &tmp);
+    Slice item;
+    s = Consume(&size, &tmp, &item);
     if (s.ok() || s.IsIncomplete()) {
       // Do nothing
     } else if (s.IsEndFile()) {
@@ -318,9 +582,10 @@ unsigned int BinlogReader::ReadPhysicalRecord(uint64_t *size, slash::Slice *resu
 
   int leftover = kBlockSize - last_record_offset_;
   if (leftover <= static_cast<int>(kHeaderSize)) {
-    queue_->Skip(leftover);
+    Skip(leftover);
     *size += leftover;
     last_record_offset_ = 0;
+    leftover = kBlockSize;
   }
 
   buffer_.clear();
@@ -328,7 +593,7 @@ unsigned int BinlogReader::ReadPhysicalRecord(uint64_t *size, slash::Slice *resu
   //uint64_t actual_read = 0;
   //s = queue_->Read(kHeaderSize, &buffer_, backing_store_, &actual_read);
   //*size += actual_read;
-  s = queue_->Read(kHeaderSize, &buffer_, backing_store_);
+  s = Read(kHeaderSize, &buffer_);
   if (s.IsEndFile()) {
     return kEof;
   } else if (!s.ok()) {
@@ -341,22 +606,46 @@ unsigned int BinlogReader::ReadPhysicalRecord(uint64_t *size, slash::Slice *resu
   const uint32_t a = static_cast<uint32_t>(header[0]) & 0xff;
   const uint32_t b = static_cast<uint32_t>(header[1]) & 0xff;
   const uint32_t c = static_cast<uint32_t>(header[2]) & 0xff;
-  const unsigned int type = header[3];
+  const char type_byte = header[3];
+  unsigned int type = static_cast<unsigned int>(type_byte) & 0xff;
   const uint32_t length = a | (b << 8) | (c << 16);
 
+  if (type == kZeroType && length == 0
+      && leftover <= static_cast<int>(kCrcHeaderSize)) {
+    // Trailer left by writer of record with checksum
+    Skip(leftover - kHeaderSize);
+    *size += leftover - kHeaderSize;
+    last_record_offset_ = 0;
+    return ReadPhysicalRecord(size, result);
+  }
+
+  bool checksum = (type & kRecordCrcFlag) != 0;
+  size_t crc_size = 0;
+  if (checksum) {
+    type &= ~kRecordCrcFlag;
+    crc_size = kCrcHeaderSize - kHeaderSize;
+  }
+  if (last_record_offset_ + crc_size + length > kBlockSize) {
+    // Corrupted length, which would overrun the block
+    return kBadRecord;
+  }
+
+  // Checksum and content in one read
   buffer_.clear();
-  //s = queue_->Read(length, &buffer_, backing_store_, &actual_read);
-  //*size += actual_read;
-  s = queue_->Read(length, &buffer_, backing_store_);
-  *result = slash::Slice(buffer_.data(), buffer_.size());
+  s = Read(crc_size + length, &buffer_);
   if (s.IsEndFile()) {
     return kEof;
-  } else if (!s.ok()) {
+  } else if (!s.ok() || buffer_.size() != crc_size + length) {
     return kBadRecord;
   }
-  *size += length;
-  last_record_offset_ += length;
+  *size += crc_size + length;
+  last_record_offset_ += crc_size + length;
+  *result = slash::Slice(buffer_.data() + crc_size, length);
 
+  if (checksum && slash::DecodeFixed32(buffer_.data())
+      != ZPCrc32cExtend(ZPCrc32c(&type_byte, 1), result->data(), length)) {
+    return kBadChecksum;
+  }
   return type;
 }
 
@@ -405,6 +694,7 @@ Status Binlog::Init() {
       return s;
     }
     writer_ = new BinlogWriter(queue_);
+    ResetSyncFd(open(binlog_name.c_str(), O_RDWR), 0);
 
   } else {
     // Manifest exist
@@ -431,6 +721,7 @@ Status Binlog::Init() {
       return s;
     }
     writer_ = new BinlogWriter(queue_);
+    ResetSyncFd(open(binlog_name.c_str(), O_RDWR), file_offset);
   }
   return Status::OK();
 }
@@ -441,7 +732,11 @@ Binlog::Binlog(const std::string& binlog_path, const int file_size)
   manifest_(NULL),
   version_(NULL),
   queue_(NULL),
-  writer_(NULL) {
+  writer_(NULL),
+  sync_fd_(-1),
+  synced_offset_(0),
+  next_queue_(NULL),
+  next_sync_fd_(-1) {
     if (binlog_path_.back() != '/') {
       binlog_path_.append(1, '/');
     }
@@ -453,6 +748,82 @@ Binlog::~Binlog() {
   delete queue_;
   delete version_;
   delete manifest_;
+  ResetSyncFd(-1, 0);
+  if (next_queue_ != NULL) {
+    delete next_queue_;
+    close(next_sync_fd_);
+    slash::DeleteFile(binlog_path_ + kBinlogPrepared);
+  }
+}
+
+void Binlog::PrepareNext() {
+  {
+    slash::MutexLock l(&mutex_);
+    if (next_queue_ != NULL || queue_ == NULL
+        || queue_->Filesize() < file_size_ / 2) {
+      return;
+    }
+  }
+
+  std::string path = binlog_path_ + kBinlogPrepared;
+  int fd = open(path.c_str(), O_CREAT | O_RDWR | O_TRUNC, 0644);
+  if (fd < 0) {
+    LOG(WARNING) << "Failed to create prepared binlog: " << path
+      << ", errno: " << errno;
+    return;
+  }
+  slash::WritableFile* queue = NULL;
+  Status s = slash::AppendWritableFile(path, &queue, 0);
+  if (!s.ok()) {
+    LOG(WARNING) << "Failed to open prepared binlog: " << path
+      << ", " << s.ToString();
+    close(fd);
+    return;
+  }
+  // Extents are allocated in one go, file size is unchanged for readers
+  if (fallocate(fd, FALLOC_FL_KEEP_SIZE, 0, file_size_) != 0) {
+    DLOG(WARNING) << "Preallocate binlog failed, errno: " << errno;
+  }
+
+  slash::MutexLock l(&mutex_);
+  next_queue_ = queue;
+  next_sync_fd_ = fd;
+}
+
+// Required hold mutex_
+void Binlog::ResetSyncFd(int fd, uint64_t offset) {
+  if (sync_fd_ >= 0) {
+    close(sync_fd_);
+  }
+  sync_fd_ = fd;
+  synced_offset_ = offset;
+}
+
+// Start writeback without waiting for it, so that dirty pages
+// never pile up to be flushed at once. Called by one thread only,
+// out of mutex_ since it may still block when device queue is full
+void Binlog::SyncRange() {
+  int fd = -1;
+  uint64_t from = 0, to = 0;
+  {
+    slash::MutexLock l(&mutex_);
+    if (sync_fd_ < 0 || queue_ == NULL) {
+      return;
+    }
+    from = synced_offset_;
+    to = queue_->Filesize();
+    if (to < from + kBinlogSyncRangeSize) {
+      return;
+    }
+    // Current file may roll and its fd be closed meanwhile
+    fd = dup(sync_fd_);
+    if (fd < 0) {
+      return;
+    }
+    synced_offset_ = to;
+  }
+  sync_file_range(fd, from, to - from, SYNC_FILE_RANGE_WRITE);
+  close(fd);
 }
 
 // Required hold mutex_
@@ -465,18 +836,110 @@ void Binlog::MaybeRoll() {
 
     uint32_t pro_num = version_->pro_num() + 1;
     std::string profile = NewFileName(filename_, pro_num);
-    slash::NewWritableFile(profile, &queue_);
+    if (next_queue_ != NULL
+        && slash::RenameFile(binlog_path_ + kBinlogPrepared, profile) == 0) {
+      // Prepared ahead
+      queue_ = next_queue_;
+      ResetSyncFd(next_sync_fd_, 0);
+    } else {
+      if (next_queue_ != NULL) {
+        delete next_queue_;
+        close(next_sync_fd_);
+      }
+      slash::NewWritableFile(profile, &queue_);
+      ResetSyncFd(open(profile.c_str(), O_RDWR), 0);
+    }
+    next_queue_ = NULL;
+    next_sync_fd_ = -1;
     writer_ = new BinlogWriter(queue_);
     version_->Save(pro_num, 0);
   }
 }
 
-Status Binlog::Put(const std::string &item) {
+Status Binlog::Put(const Slice *parts, int num, bool stamp, int flags,
+    uint32_t* filenum, uint64_t* offset) {
+  assert(num < kBinlogMaxParts);
+  Status s;
+  if (!stamp) {
+    // Readable by slaves not upgraded yet
+    slash::MutexLock l(&mutex_);
+    s = Produce(BinlogStamp(), parts, num);
+    version_->Fetch(filenum, offset);
+    return s;
+  }
+
+  size_t total = 0;
+  for (int i = 0; i < num; i++) {
+    total += parts[i].size();
+  }
+  if (total < kBinlogCompressMinSize) {
+    // Too small to compress, parts are written without joining
+    flags &= ~kBinlogItemSnappy;
+  }
+  std::string encoded;
+  if (flags & kBinlogItemSnappy) {
+    // Compress out of lock, with stamp filled in later
+    std::string content;
+    content.reserve(total);
+    for (int i = 0; i < num; i++) {
+      content.append(parts[i].data(), parts[i].size());
+    }
+    EncodeBinlogItem(BinlogStamp(1, 0), Slice(content.data(), content.size()),
+        flags, &encoded);
+  }
+
+  slash::MutexLock l(&mutex_);
+  BinlogStamp next(version_->stamp().seq + 1, slash::NowMicros());
+  if (!encoded.empty()) {
+    slash::EncodeFixed64(&encoded[2], next.seq);
+    slash::EncodeFixed64(&encoded[10], next.time_us);
+    Slice item(encoded.data(), encoded.size());
+    s = Produce(next, &item, 1);
+  } else {
+    // Header goes before content, no need to join them
+    char header[kBinlogItemHeaderSize];
+    EncodeBinlogItemHeader(next, flags, header);
+    Slice item[kBinlogMaxParts];
+    item[0] = Slice(header, sizeof(header));
+    for (int i = 0; i < num; i++) {
+      item[i + 1] = parts[i];
+    }
+    s = Produce(next, item, num + 1);
+  }
+  version_->Fetch(filenum, offset);
+  return s;
+}
+
+Status Binlog::Put(const std::string &item, const BinlogStamp& stamp) {
+  std::string encoded;
+  EncodeBinlogItem(stamp, Slice(item.data(), item.size()), 0, &encoded);
+  Slice encoded_item(encoded.data(), encoded.size());
   slash::MutexLock l(&mutex_);
+  return Produce(stamp, &encoded_item, 1);
+}
+
+Status Binlog::PutItem(const std::string &item) {
+  BinlogStamp stamp;
+  Slice encoded_item(item.data(), item.size());
+  DecodeBinlogItem(encoded_item, &stamp);
+  slash::MutexLock l(&mutex_);
+  return Produce(stamp, &encoded_item, 1);
+}
 
+// Required hold mutex_
+// item is encoded already, given in parts
+Status Binlog::Produce(const BinlogStamp& stamp, const Slice *parts,
+    int num) {
   int64_t go_ahead = 0;
-  Status s = writer_->Produce(Slice(item.data(), item.size()), &go_ahead);
-  version_->Inc(go_ahead);
+  // Unstamped items, from an old master or with binlog_stamp off,
+  // are written without checksum, the same as old versions
+  Status s = writer_->Produce(parts, num, stamp.seq > 0, &go_ahead);
+  if (stamp.seq == 0) {
+    // Not stamped by an old master, keep the last one
+    version_->Inc(go_ahead);
+  } else {
+    version_->Inc(go_ahead, stamp);
+  }
   MaybeRoll();
   if (!s.ok()) {
     LOG(WARNING) << "Binlog write failed: " << s.ToString();
@@ -553,6 +1016,7 @@ Status Binlog::SetProducerStatus(uint32_t pro_num, uint64_t pro_offset,
   std::string profile = NewFileName(filename_, pro_num);
   slash::NewWritableFile(profile, &queue_);
   writer_ = new BinlogWriter(queue_);
+  ResetSyncFd(open(profile.c_str(), O_RDWR), 0);
   
   // TODO(wangk) Optimize, actual_offset should be as close as the pro_offset 
   // with writer_->Fallback();
@@ -1,6 +1,7 @@
 #include "include/zp_conf.h"
 #include "include/zp_const.h"
 
+#include "slash/include/env.h"
 #include "slash/include/base_conf.h"
 
 static int64_t BoundaryLimit(int64_t target, int64_t floor, int64_t ceil) {
@@ -9,155 +10,372 @@ static int64_t BoundaryLimit(int64_t target, int64_t floor, int64_t ceil) {
   return target;
 }
 
+ZpConfItems::ZpConfItems()
+    : local_ip("127.0.0.1"),
+      local_port(9999),
+      timeout(100),
+      data_path("data"),
+      log_path("log"),
+      trash_path("trash"),
+      daemonize(false),
+      pid_file(log_path + "/" + kZpPidFile),
+      lock_file(log_path + "/" + kZpLockFile),
+      enable_data_delete(true),
+      enable_get_coalesce(false),
+      meta_thread_num(4),
+      data_thread_num(6),
+      data_exec_thread_num(0),
+      sync_recv_thread_num(4),
+      sync_send_thread_num(4),
+      max_background_flushes(24),
+      max_background_compactions(24),
+      binlog_remain_days(kBinlogRemainMaxDay),
+      binlog_remain_min_count(kBinlogRemainMinCount),
+      binlog_remain_max_count(kBinlogRemainMaxCount),
+      binlog_stamp(false),
+      binlog_compression(false),
+      binlog_compact_record(false),
+      db_write_buffer_size(256 * 1024), // 256KB
+      db_max_write_buffer(20 * 1024 * 1024), // 20MB
+      db_target_file_size_base(256 * 1024), // 256KB
+      db_max_open_files(4096),
+      db_block_size(16), // 16 B
+      slowlog_slower_than(-1),
+      slowlog_perf_sample_rate(0),
+      stuck_offset_dist(kMetaOffsetStuckDist), // 100KB
+      slowdown_delay_radio(kSlowdownDelayRatio),  // 60%
+      row_cache_size(0),
+      trace_sample_rate(0),
+      metrics_port(0),
+      floyd_check_leader_us(15000000),
+      floyd_heartbeat_us(6000000),
+      floyd_append_entries_size_once(1024000),
+      floyd_append_entries_count_once(128) {
+}
+
+// Items could be changed at runtime
+struct HotIntItem {
+  const char* name;
+  int ZpConfItems::* field;
+};
+static const HotIntItem kHotIntItems[] = {
+  {"binlog_remain_days", &ZpConfItems::binlog_remain_days},
+  {"binlog_remain_min_count", &ZpConfItems::binlog_remain_min_count},
+  {"binlog_remain_max_count", &ZpConfItems::binlog_remain_max_count},
+  {"slowlog_slower_than", &ZpConfItems::slowlog_slower_than},
+  {"slowlog_perf_sample_rate", &ZpConfItems::slowlog_perf_sample_rate},
+  {"stuck_offset_dist", &ZpConfItems::stuck_offset_dist},
+  {"slowdown_delay_radio", &ZpConfItems::slowdown_delay_radio},
+  {"trace_sample_rate", &ZpConfItems::trace_sample_rate},
+};
+struct HotBoolItem {
+  const char* name;
+  bool ZpConfItems::* field;
+};
+static const HotBoolItem kHotBoolItems[] = {
+  {"enable_data_delete", &ZpConfItems::enable_data_delete},
+  {"enable_get_coalesce", &ZpConfItems::enable_get_coalesce},
+  {"binlog_stamp", &ZpConfItems::binlog_stamp},
+  {"binlog_compression", &ZpConfItems::binlog_compression},
+  {"binlog_compact_record", &ZpConfItems::binlog_compact_record},
+};
+
+static int ReadItems(const std::string& path, ZpConfItems* c) {
+  slash::BaseConf conf_reader(path);
+  int res = conf_reader.LoadConf();
+  if (res != 0) {
+    return res;
+  }
+
+  conf_reader.GetConfStr("local_ip", &c->local_ip);
+  conf_reader.GetConfInt("local_port", &c->local_port);
+  conf_reader.GetConfStr("data_path", &c->data_path);
+  conf_reader.GetConfStr("log_path", &c->log_path);
+  conf_reader.GetConfStr("trash_path", &c->trash_path);
+  conf_reader.GetConfBool("daemonize", &c->daemonize);
+  conf_reader.GetConfStrVec("meta_addr", &c->meta_addr);
+  conf_reader.GetConfBool("enable_data_delete", &c->enable_data_delete);
+  conf_reader.GetConfBool("enable_get_coalesce", &c->enable_get_coalesce);
+  conf_reader.GetConfInt("meta_thread_num", &c->meta_thread_num);
+  conf_reader.GetConfInt("data_thread_num", &c->data_thread_num);
+  conf_reader.GetConfInt("data_exec_thread_num", &c->data_exec_thread_num);
+  conf_reader.GetConfInt("sync_recv_thread_num", &c->sync_recv_thread_num);
+  conf_reader.GetConfInt("sync_send_thread_num", &c->sync_send_thread_num);
+  conf_reader.GetConfInt("max_background_flushes", &c->max_background_flushes);
+  conf_reader.GetConfInt("max_background_compactions", &c->max_background_compactions);
+  conf_reader.GetConfInt("binlog_remain_days", &c->binlog_remain_days);
+  conf_reader.GetConfInt("binlog_remain_min_count", &c->binlog_remain_min_count);
+  conf_reader.GetConfInt("binlog_remain_max_count", &c->binlog_remain_max_count);
+  conf_reader.GetConfBool("binlog_stamp", &c->binlog_stamp);
+  conf_reader.GetConfBool("binlog_compression", &c->binlog_compression);
+  conf_reader.GetConfBool("binlog_compact_record", &c->binlog_compact_record);
+  conf_reader.GetConfInt("db_write_buffer_size", &c->db_write_buffer_size);
+  conf_reader.GetConfInt("db_max_write_buffer", &c->db_max_write_buffer);
+  conf_reader.GetConfInt("db_target_file_size_base", &c->db_target_file_size_base);
+  conf_reader.GetConfInt("db_max_open_files", &c->db_max_open_files);
+  conf_reader.GetConfInt("db_block_size", &c->db_block_size);
+  conf_reader.GetConfInt("slowlog_slower_than", &c->slowlog_slower_than);
+  conf_reader.GetConfInt("slowlog_perf_sample_rate",
+      &c->slowlog_perf_sample_rate);
+  conf_reader.GetConfInt("stuck_offset_dist", &c->stuck_offset_dist);
+  conf_reader.GetConfInt("slowdown_delay_radio", &c->slowdown_delay_radio);
+  conf_reader.GetConfInt("row_cache_size", &c->row_cache_size);
+  conf_reader.GetConfInt("trace_sample_rate", &c->trace_sample_rate);
+  conf_reader.GetConfInt("metrics_port", &c->metrics_port);
+  conf_reader.GetConfInt("floyd_check_leader_us", &c->floyd_check_leader_us);
+  conf_reader.GetConfInt("floyd_heartbeat_us", &c->floyd_heartbeat_us);
+  conf_reader.GetConfInt("floyd_append_entries_size_once", &c->floyd_append_entries_size_once);
+  conf_reader.GetConfInt("floyd_append_entries_count_once", &c->floyd_append_entries_count_once);
+  return 0;
+}
+
+// Could be applied more than once
+static void NormalizeItems(ZpConfItems* c) {
+  if (c->data_path.back() != '/') {
+    c->data_path.append("/");
+  }
+  if (c->log_path.back() != '/') {
+    c->log_path.append("/");
+  }
+  if (c->trash_path.back() != '/') {
+    c->trash_path.append("/");
+  }
+  std::string lock_path = c->log_path;
+  c->pid_file = lock_path + "pid";
+  c->lock_file = lock_path + "lock";
+
+  c->meta_thread_num = BoundaryLimit(c->meta_thread_num, 1, 100);
+  c->data_thread_num = BoundaryLimit(c->data_thread_num, 1, 100);
+  c->data_exec_thread_num = BoundaryLimit(c->data_exec_thread_num, 0, 100);
+  c->sync_recv_thread_num = BoundaryLimit(c->sync_recv_thread_num, 1, 100);
+  c->sync_send_thread_num = BoundaryLimit(c->sync_send_thread_num, 1, 100);
+  c->max_background_flushes = BoundaryLimit(c->max_background_flushes, 10, 100);
+  c->max_background_compactions = BoundaryLimit(c->max_background_compactions, 10, 100);
+  c->binlog_remain_days = BoundaryLimit(c->binlog_remain_days, 0, 30);
+  c->binlog_remain_min_count = BoundaryLimit(c->binlog_remain_min_count, 10, 60);
+  c->binlog_remain_max_count = BoundaryLimit(c->binlog_remain_max_count, 10, 60);
+  c->binlog_remain_min_count = c->binlog_remain_min_count > c->binlog_remain_max_count ?
+    c->binlog_remain_max_count : c->binlog_remain_min_count;
+  c->slowlog_slower_than = BoundaryLimit(c->slowlog_slower_than, -1, 10000000);
+  c->slowlog_perf_sample_rate = BoundaryLimit(c->slowlog_perf_sample_rate, 0, 100000000);
+  c->stuck_offset_dist = BoundaryLimit(c->stuck_offset_dist, 1, 100 * 1024 * 1024);
+  c->slowdown_delay_radio = BoundaryLimit(c->slowdown_delay_radio, 1, 100);
+  c->row_cache_size = BoundaryLimit(c->row_cache_size, 0, 64 * 1024); // 0 ~ 64G
+  c->trace_sample_rate = BoundaryLimit(c->trace_sample_rate, 0, 100000000);
+  c->metrics_port = BoundaryLimit(c->metrics_port, 0, 65535);
+  c->db_write_buffer_size = BoundaryLimit(c->db_write_buffer_size, 4 * 1024, 10 * 1024 * 1024); // 4M ~ 10G
+  c->db_max_write_buffer = BoundaryLimit(c->db_max_write_buffer, 1024 * 1024, 500 * 1024 * 1024); // 1G ~ 500G
+  c->db_target_file_size_base = BoundaryLimit(c->db_target_file_size_base, 4 * 1024, 10 * 1024 * 1024); // 4M ~ 10G
+  c->db_block_size = BoundaryLimit(c->db_block_size, 4, 1024 * 1024); // 14K ~ 1G
+}
+
 ZpConf::ZpConf()
-    : local_ip_("127.0.0.1"),
-      local_port_(9999),
-      timeout_(100),
-      data_path_("data"),
-      log_path_("log"),
-      trash_path_("trash"),
-      daemonize_(false),
-      pid_file_(log_path_ + "/" + kZpPidFile),
-      lock_file_(log_path_ + "/" + kZpLockFile),
-      enable_data_delete_(true),
-      meta_thread_num_(4),
-      data_thread_num_(6),
-      sync_recv_thread_num_(4),
-      sync_send_thread_num_(4),
-      max_background_flushes_(24),
-      max_background_compactions_(24),
-      binlog_remain_days_(kBinlogRemainMaxDay),
-      binlog_remain_min_count_(kBinlogRemainMinCount),
-      binlog_remain_max_count_(kBinlogRemainMaxCount),
-      db_write_buffer_size_(256 * 1024), // 256KB
-      db_max_write_buffer_(20 * 1024 * 1024), // 20MB
-      db_target_file_size_base_(256 * 1024), // 256KB
-      db_max_open_files_(4096),
-      db_block_size_(16), // 16 B
-      slowlog_slower_than_(-1),
-      stuck_offset_dist_(kMetaOffsetStuckDist), // 100KB
-      slowdown_delay_radio_(kSlowdownDelayRatio),  // 60%
-      floyd_check_leader_us_(15000000),
-      floyd_heartbeat_us_(6000000),
-      floyd_append_entries_size_once_(1024000),
-      floyd_append_entries_count_once_(128) {
-  pthread_rwlock_init(&rwlock_, NULL);
+  : items_(new ZpConfItems()) {
 }
 
 ZpConf::~ZpConf() {
-  pthread_rwlock_destroy(&rwlock_);
+  delete items();
+  for (auto& retired : retired_) {
+    delete retired.second;
+  }
+}
+
+// Required: hold mu_
+void ZpConf::Publish(ZpConfItems* items) {
+  uint64_t now = slash::NowMicros();
+  while (!retired_.empty()
+      && retired_.front().first
+        + static_cast<uint64_t>(kConfRetireGrace) * 1000000 <= now) {
+    delete retired_.front().second;
+    retired_.pop_front();
+  }
+  retired_.push_back(std::make_pair(now,
+        items_.exchange(items, std::memory_order_acq_rel)));
 }
 
 void ZpConf::Dump() const {
-  auto iter = meta_addr_.begin();
-  while (iter != meta_addr_.end()) {
+  const ZpConfItems* c = items();
+  auto iter = c->meta_addr.begin();
+  while (iter != c->meta_addr.end()) {
     fprintf(stderr, "    Config.meta_addr         : %s\n", iter->c_str());
     iter++;
   }
-  fprintf (stderr, "    Config.local_ip           : %s\n", local_ip_.c_str());
-  fprintf (stderr, "    Config.local_port         : %d\n", local_port_);
-  fprintf (stderr, "    Config.data_path          : %s\n", data_path_.c_str());
-  fprintf (stderr, "    Config.log_path           : %s\n", log_path_.c_str());
-  fprintf (stderr, "    Config.trash_path         : %s\n", trash_path_.c_str());
-  fprintf (stderr, "    Config.daemonize          : %s\n", daemonize_? "true":"false");
-  fprintf (stderr, "    Config.pid_file           : %s\n", pid_file_.c_str());
-  fprintf (stderr, "    Config.lock_file          : %s\n", lock_file_.c_str());
-  fprintf (stderr, "    Config.enable_data_delete : %s\n", enable_data_delete_ ? "true":"false");
-
-  fprintf (stderr, "    Config.meta_thread_num            : %d\n", meta_thread_num_);
-  fprintf (stderr, "    Config.data_thread_num            : %d\n", data_thread_num_);
-  fprintf (stderr, "    Config.sync_recv_thread_num       : %d\n", sync_recv_thread_num_);
-  fprintf (stderr, "    Config.sync_send_thread_num       : %d\n", sync_send_thread_num_);
-  fprintf (stderr, "    Config.max_background_flushes     : %d\n", max_background_flushes_);
-  fprintf (stderr, "    Config.max_background_compactions : %d\n", max_background_compactions_);
-
-  fprintf (stderr, "    Config.binlog_remain_days       : %d\n", binlog_remain_days_);
-  fprintf (stderr, "    Config.binlog_remain_min_count  : %d\n", binlog_remain_min_count_);
-  fprintf (stderr, "    Config.binlog_remain_max_count  : %d\n", binlog_remain_max_count_);
-
-  fprintf (stderr, "    Config.db_write_buffer_size     : %dKB\n", db_write_buffer_size_ / 1024);
-  fprintf (stderr, "    Config.db_max_write_buffer      : %dMB\n", db_max_write_buffer_ / 1024 / 1024);
-  fprintf (stderr, "    Config.db_target_file_size_base : %dKB\n", db_target_file_size_base_ / 1024);
-  fprintf (stderr, "    Config.db_max_open_files        : %d\n", db_max_open_files_);
-  fprintf (stderr, "    Config.db_block_size            : %dB\n", db_block_size_);
-  fprintf (stderr, "    Config.slowlog_slower_than      : %d\n", slowlog_slower_than_);
-  fprintf (stderr, "    Config.stuck_offset_dist        : %dKB\n", stuck_offset_dist_ / 1024);
-  fprintf (stderr, "    Config.slowdown_delay_radio     : %d%%\n", slowdown_delay_radio_);
-
-  fprintf (stderr, "    Config.floyd_check_leader_us            : %d\n", floyd_check_leader_us_);
-  fprintf (stderr, "    Config.floyd_heartbeat_us               : %d\n", floyd_heartbeat_us_);
-  fprintf (stderr, "    Config.floyd_append_entries_size_once_  : %d\n", floyd_append_entries_size_once_);
-  fprintf (stderr, "    Config.floyd_append_entries_count_once_ : %d\n", floyd_append_entries_count_once_);
+  fprintf (stderr, "    Config.local_ip           : %s\n", c->local_ip.c_str());
+  fprintf (stderr, "    Config.local_port         : %d\n", c->local_port);
+  fprintf (stderr, "    Config.data_path          : %s\n", c->data_path.c_str());
+  fprintf (stderr, "    Config.log_path           : %s\n", c->log_path.c_str());
+  fprintf (stderr, "    Config.trash_path         : %s\n", c->trash_path.c_str());
+  fprintf (stderr, "    Config.daemonize          : %s\n", c->daemonize? "true":"false");
+  fprintf (stderr, "    Config.pid_file           : %s\n", c->pid_file.c_str());
+  fprintf (stderr, "    Config.lock_file          : %s\n", c->lock_file.c_str());
+  fprintf (stderr, "    Config.enable_data_delete : %s\n", c->enable_data_delete ? "true":"false");
+  fprintf (stderr, "    Config.enable_get_coalesce: %s\n", c->enable_get_coalesce ? "true":"false");
+
+  fprintf (stderr, "    Config.meta_thread_num            : %d\n", c->meta_thread_num);
+  fprintf (stderr, "    Config.data_thread_num            : %d\n", c->data_thread_num);
+  fprintf (stderr, "    Config.data_exec_thread_num       : %d\n", c->data_exec_thread_num);
+  fprintf (stderr, "    Config.sync_recv_thread_num       : %d\n", c->sync_recv_thread_num);
+  fprintf (stderr, "    Config.sync_send_thread_num       : %d\n", c->sync_send_thread_num);
+  fprintf (stderr, "    Config.max_background_flushes     : %d\n", c->max_background_flushes);
+  fprintf (stderr, "    Config.max_background_compactions : %d\n", c->max_background_compactions);
+
+  fprintf (stderr, "    Config.binlog_remain_days       : %d\n", c->binlog_remain_days);
+  fprintf (stderr, "    Config.binlog_remain_min_count  : %d\n", c->binlog_remain_min_count);
+  fprintf (stderr, "    Config.binlog_remain_max_count  : %d\n", c->binlog_remain_max_count);
+  fprintf (stderr, "    Config.binlog_stamp             : %s\n", c->binlog_stamp ? "true":"false");
+  fprintf (stderr, "    Config.binlog_compression       : %s\n", c->binlog_compression ? "true":"false");
+  fprintf (stderr, "    Config.binlog_compact_record    : %s\n", c->binlog_compact_record ? "true":"false");
+
+  fprintf (stderr, "    Config.db_write_buffer_size     : %dKB\n", c->db_write_buffer_size / 1024);
+  fprintf (stderr, "    Config.db_max_write_buffer      : %dMB\n", c->db_max_write_buffer / 1024 / 1024);
+  fprintf (stderr, "    Config.db_target_file_size_base : %dKB\n", c->db_target_file_size_base / 1024);
+  fprintf (stderr, "    Config.db_max_open_files        : %d\n", c->db_max_open_files);
+  fprintf (stderr, "    Config.db_block_size            : %dB\n", c->db_block_size);
+  fprintf (stderr, "    Config.slowlog_slower_than      : %d\n", c->slowlog_slower_than);
+  fprintf (stderr, "    Config.slowlog_perf_sample_rate : %d\n", c->slowlog_perf_sample_rate);
+  fprintf (stderr, "    Config.stuck_offset_dist        : %dKB\n", c->stuck_offset_dist / 1024);
+  fprintf (stderr, "    Config.slowdown_delay_radio     : %d%%\n", c->slowdown_delay_radio);
+  fprintf (stderr, "    Config.row_cache_size           : %dMB\n", c->row_cache_size);
+  fprintf (stderr, "    Config.trace_sample_rate        : %d\n", c->trace_sample_rate);
+  fprintf (stderr, "    Config.metrics_port             : %d\n", c->metrics_port);
+
+  fprintf (stderr, "    Config.floyd_check_leader_us            : %d\n", c->floyd_check_leader_us);
+  fprintf (stderr, "    Config.floyd_heartbeat_us               : %d\n", c->floyd_heartbeat_us);
+  fprintf (stderr, "    Config.floyd_append_entries_size_once_  : %d\n", c->floyd_append_entries_size_once);
+  fprintf (stderr, "    Config.floyd_append_entries_count_once_ : %d\n", c->floyd_append_entries_count_once);
 }
 
 int ZpConf::Load(const std::string& path) {
-  slash::BaseConf conf_reader(path);
-  int res = conf_reader.LoadConf();
-  if (res != 0) {
-    return res;
+  ZpConfItems* c = new ZpConfItems();
+  int ret = ReadItems(path, c);
+  if (ret != 0) {
+    delete c;
+    return ret;
   }
+  NormalizeItems(c);
 
-  bool ret = false;
-  ret = conf_reader.GetConfStr("local_ip", &local_ip_);
-  ret = conf_reader.GetConfInt("local_port", &local_port_);
-  ret = conf_reader.GetConfStr("data_path", &data_path_);
-  ret = conf_reader.GetConfStr("log_path", &log_path_);
-  ret = conf_reader.GetConfStr("trash_path", &trash_path_);
-  ret = conf_reader.GetConfBool("daemonize", &daemonize_);
-  ret = conf_reader.GetConfStrVec("meta_addr", &meta_addr_);
-  ret = conf_reader.GetConfBool("enable_data_delete", &enable_data_delete_);
-  ret = conf_reader.GetConfInt("meta_thread_num", &meta_thread_num_);
-  ret = conf_reader.GetConfInt("data_thread_num", &data_thread_num_);
-  ret = conf_reader.GetConfInt("sync_recv_thread_num", &sync_recv_thread_num_);
-  ret = conf_reader.GetConfInt("sync_send_thread_num", &sync_send_thread_num_);
-  ret = conf_reader.GetConfInt("max_background_flushes", &max_background_flushes_);
-  ret = conf_reader.GetConfInt("max_background_compactions", &max_background_compactions_);
-  ret = conf_reader.GetConfInt("binlog_remain_days", &binlog_remain_days_);
-  ret = conf_reader.GetConfInt("binlog_remain_min_count", &binlog_remain_min_count_);
-  ret = conf_reader.GetConfInt("binlog_remain_max_count", &binlog_remain_max_count_);
-  ret = conf_reader.GetConfInt("db_write_buffer_size", &db_write_buffer_size_);
-  ret = conf_reader.GetConfInt("db_max_write_buffer", &db_max_write_buffer_);
-  ret = conf_reader.GetConfInt("db_target_file_size_base", &db_target_file_size_base_);
-  ret = conf_reader.GetConfInt("db_max_open_files", &db_max_open_files_);
-  ret = conf_reader.GetConfInt("db_block_size", &db_block_size_);
-  ret = conf_reader.GetConfInt("slowlog_slower_than", &slowlog_slower_than_);
-  ret = conf_reader.GetConfInt("stuck_offset_dist", &stuck_offset_dist_);
-  ret = conf_reader.GetConfInt("slowdown_delay_radio", &slowdown_delay_radio_);
-  ret = conf_reader.GetConfInt("floyd_check_leader_us", &floyd_check_leader_us_);
-  ret = conf_reader.GetConfInt("floyd_heartbeat_us", &floyd_heartbeat_us_);
-  ret = conf_reader.GetConfInt("floyd_append_entries_size_once", &floyd_append_entries_size_once_);
-  ret = conf_reader.GetConfInt("floyd_append_entries_count_once", &floyd_append_entries_count_once_);
-  
-  if (data_path_.back() != '/') {
-    data_path_.append("/");
-  }
-  if (log_path_.back() != '/') {
-    log_path_.append("/");
-  }
-  if (trash_path_.back() != '/') {
-    trash_path_.append("/");
-  }
-  std::string lock_path = log_path_;
-  pid_file_ = lock_path + "pid";
-  lock_file_ = lock_path + "lock";
-
-  meta_thread_num_ = BoundaryLimit(meta_thread_num_, 1, 100);
-  data_thread_num_ = BoundaryLimit(data_thread_num_, 1, 100);
-  sync_recv_thread_num_ = BoundaryLimit(sync_recv_thread_num_, 1, 100);
-  sync_send_thread_num_ = BoundaryLimit(sync_send_thread_num_, 1, 100);
-  max_background_flushes_ = BoundaryLimit(max_background_flushes_, 10, 100);
-  max_background_compactions_ = BoundaryLimit(max_background_compactions_, 10, 100);
-  binlog_remain_days_ = BoundaryLimit(binlog_remain_days_, 0, 30);
-  binlog_remain_min_count_ = BoundaryLimit(binlog_remain_min_count_, 10, 60);
-  binlog_remain_max_count_ = BoundaryLimit(binlog_remain_max_count_, 10, 60);
-  binlog_remain_min_count_ = binlog_remain_min_count_ > binlog_remain_max_count_ ?
-    binlog_remain_max_count_ : binlog_remain_min_count_;
-  slowlog_slower_than_ = BoundaryLimit(slowlog_slower_than_, -1, 10000000);
-  stuck_offset_dist_ = BoundaryLimit(stuck_offset_dist_, 1, 100 * 1024 * 1024);
-  slowdown_delay_radio_ = BoundaryLimit(slowdown_delay_radio_, 1, 100);
-  db_write_buffer_size_ = BoundaryLimit(db_write_buffer_size_, 4 * 1024, 10 * 1024 * 1024); // 4M ~ 10G
-  db_max_write_buffer_ = BoundaryLimit(db_max_write_buffer_, 1024 * 1024, 500 * 1024 * 1024); // 1G ~ 500G
-  db_target_file_size_base_ = BoundaryLimit(db_target_file_size_base_, 4 * 1024, 10 * 1024 * 1024); // 4M ~ 10G
-  db_block_size_ = BoundaryLimit(db_block_size_, 4, 1024 * 1024); // 14K ~ 1G
+  slash::MutexLock l(&mu_);
+  path_ = path;
+  Publish(c);
   return ret;
 }
+
+int ZpConf::Reload() {
+  slash::MutexLock l(&mu_);
+  ZpConfItems loaded;
+  int ret = ReadItems(path_, &loaded);
+  if (ret != 0) {
+    return ret;
+  }
+  NormalizeItems(&loaded);
+
+  ZpConfItems* c = new ZpConfItems(*items());
+  for (auto& item : kHotIntItems) {
+    c->*(item.field) = loaded.*(item.field);
+  }
+  for (auto& item : kHotBoolItems) {
+    c->*(item.field) = loaded.*(item.field);
+  }
+  Publish(c);
+  return ret;
+}
+
+bool ZpConf::Set(const std::string& name, const std::string& value,
+    std::string* msg) {
+  slash::MutexLock l(&mu_);
+  ZpConfItems* c = new ZpConfItems(*items());
+  bool found = false;
+  for (auto& item : kHotIntItems) {
+    if (name != item.name) {
+      continue;
+    }
+    long ival = 0;
+    if (!slash::string2l(value.data(), value.size(), &ival)) {
+      *msg = "invalid value for " + name;
+      delete c;
+      return false;
+    }
+    c->*(item.field) = static_cast<int>(BoundaryLimit(ival, INT32_MIN,
+          INT32_MAX));
+    found = true;
+  }
+  for (auto& item : kHotBoolItems) {
+    if (name != item.name) {
+      continue;
+    }
+    std::string lower = slash::StringToLower(value);
+    if (lower != "yes" && lower != "true"
+        && lower != "no" && lower != "false") {
+      *msg = "invalid value for " + name + ", should be yes or no";
+      delete c;
+      return false;
+    }
+    c->*(item.field) = (lower == "yes" || lower == "true");
+    found = true;
+  }
+  if (!found) {
+    *msg = "unknown or unchangeable item " + name;
+    delete c;
+    return false;
+  }
+
+  NormalizeItems(c);
+  Publish(c);
+  return true;
+}
+
+void ZpConf::Get(const std::string& pattern,
+    std::vector<std::pair<std::string, std::string>>* result) const {
+  const ZpConfItems* c = items();
+  std::string meta_addr;
+  for (auto& addr : c->meta_addr) {
+    if (!meta_addr.empty()) {
+      meta_addr.append(",");
+    }
+    meta_addr.append(addr);
+  }
+  std::vector<std::pair<std::string, std::string>> all = {
+    {"meta_addr", meta_addr},
+    {"local_ip", c->local_ip},
+    {"local_port", std::to_string(c->local_port)},
+    {"data_path", c->data_path},
+    {"log_path", c->log_path},
+    {"trash_path", c->trash_path},
+    {"daemonize", c->daemonize ? "yes" : "no"},
+    {"enable_data_delete", c->enable_data_delete ? "yes" : "no"},
+    {"enable_get_coalesce", c->enable_get_coalesce ? "yes" : "no"},
+    {"meta_thread_num", std::to_string(c->meta_thread_num)},
+    {"data_thread_num", std::to_string(c->data_thread_num)},
+    {"data_exec_thread_num", std::to_string(c->data_exec_thread_num)},
+    {"sync_recv_thread_num", std::to_string(c->sync_recv_thread_num)},
+    {"sync_send_thread_num", std::to_string(c->sync_send_thread_num)},
+    {"max_background_flushes", std::to_string(c->max_background_flushes)},
+    {"max_background_compactions",
+      std::to_string(c->max_background_compactions)},
+    {"binlog_remain_days", std::to_string(c->binlog_remain_days)},
+    {"binlog_remain_min_count", std::to_string(c->binlog_remain_min_count)},
+    {"binlog_remain_max_count", std::to_string(c->binlog_remain_max_count)},
+    {"binlog_stamp", c->binlog_stamp ? "yes" : "no"},
+    {"binlog_compression", c->binlog_compression ? "yes" : "no"},
+    {"binlog_compact_record", c->binlog_compact_record ? "yes" : "no"},
+    {"db_write_buffer_size", std::to_string(c->db_write_buffer_size)},
+    {"db_max_write_buffer", std::to_string(c->db_max_write_buffer)},
+    {"db_target_file_size_base",
+      std::to_string(c->db_target_file_size_base)},
+    {"db_max_open_files", std::to_string(c->db_max_open_files)},
+    {"db_block_size", std::to_string(c->db_block_size)},
+    {"slowlog_slower_than", std::to_string(c->slowlog_slower_than)},
+    {"slowlog_perf_sample_rate",
+      std::to_string(c->slowlog_perf_sample_rate)},
+    {"stuck_offset_dist", std::to_string(c->stuck_offset_dist)},
+    {"slowdown_delay_radio", std::to_string(c->slowdown_delay_radio)},
+    {"row_cache_size", std::to_string(c->row_cache_size)},
+    {"trace_sample_rate", std::to_string(c->trace_sample_rate)},
+    {"metrics_port", std::to_string(c->metrics_port)},
+  };
+  for (auto& item : all) {
+    if (slash::stringmatch(pattern.data(), item.first.data(), 1)) {
+      result->push_back(item);
+    }
+  }
+}
@@ -0,0 +1,61 @@
+#include "include/zp_crc32c.h"
+
+#include <string.h>
+#ifdef __SSE4_2__
+#include <nmmintrin.h>
+#endif
+
+#ifdef __SSE4_2__
+
+uint32_t ZPCrc32cExtend(uint32_t crc, const char* data, size_t n) {
+  const char* p = data;
+  const char* end = data + n;
+  uint64_t l = crc ^ 0xffffffffu;
+
+  // Align to 8 bytes
+  while (p < end && (reinterpret_cast<uintptr_t>(p) & 7) != 0) {
+    l = _mm_crc32_u8(static_cast<uint32_t>(l), *p++);
+  }
+  while (end - p >= 8) {
+    uint64_t word;
+    memcpy(&word, p, sizeof(word));
+    l = _mm_crc32_u64(l, word);
+    p += 8;
+  }
+  while (p < end) {
+    l = _mm_crc32_u8(static_cast<uint32_t>(l), *p++);
+  }
+  return static_cast<uint32_t>(l) ^ 0xffffffffu;
+}
+
+#else
+
+namespace {
+
+struct Crc32cTable {
+  uint32_t t[256];
+  Crc32cTable() {
+    for (uint32_t i = 0; i < 256; i++) {
+      uint32_t c = i;
+      for (int k = 0; k < 8; k++) {
+        c = (c & 1) ? (c >> 1) ^ 0x82f63b78u : c >> 1;
+      }
+      t[i] = c;
+    }
+  }
+};
+
+const Crc32cTable kCrc32cTable;
+
+}  // namespace
+
+uint32_t ZPCrc32cExtend(uint32_t crc, const char* data, size_t n) {
+  const uint8_t* p = reinterpret_cast<const uint8_t*>(data);
+  uint32_t c = crc ^ 0xffffffffu;
+  for (size_t i = 0; i < n; i++) {
+    c = kCrc32cTable.t[(c ^ p[i]) & 0xff] ^ (c >> 8);
+  }
+  return c ^ 0xffffffffu;
+}
+
+#endif
@@ -0,0 +1,192 @@
+#include "include/zp_log.h"
+
+#include <unistd.h>
+
+#include "include/zp_const.h"
+
+#include "slash/include/env.h"
+
+static const google::LogSeverity kAsyncSeverities[] = {
+  google::INFO, google::WARNING, google::ERROR
+};
+static const int kAsyncSeverityNum = 3;
+static ZPAsyncLogger* async_loggers[kAsyncSeverityNum];
+
+void ZPLogInit() {
+  for (int i = 0; i < kAsyncSeverityNum; i++) {
+    ZPAsyncLogger* logger = new ZPAsyncLogger(
+        google::base::GetLogger(kAsyncSeverities[i]));
+    if (!logger->Start()) {
+      // Keep writing synchronously
+      LOG(WARNING) << "Async logger start failed, severity: "
+        << kAsyncSeverities[i];
+      delete logger;
+      continue;
+    }
+    async_loggers[i] = logger;
+    google::base::SetLogger(kAsyncSeverities[i], logger);
+  }
+}
+
+// Loggers are left to glog, see ZPAsyncLogger
+void ZPLogShutdown() {
+  for (int i = 0; i < kAsyncSeverityNum; i++) {
+    if (async_loggers[i] == NULL) {
+      continue;
+    }
+    async_loggers[i]->Stop();
+    async_loggers[i] = NULL;
+  }
+}
+
+////// ZPAsyncLogger ///// /
+ZPAsyncLogger::ZPAsyncLogger(google::base::Logger* wrapped)
+  : wrapped_(wrapped),
+  slots_(kLogRingSize),
+  tail_(0),
+  dropped_(0),
+  sync_(false),
+  head_(0),
+  flush_thread_(NULL) {
+    for (size_t i = 0; i < slots_.size(); i++) {
+      slots_[i].seq = i;
+    }
+  }
+
+ZPAsyncLogger::~ZPAsyncLogger() {
+  delete flush_thread_;
+  Drain();
+}
+
+bool ZPAsyncLogger::Start() {
+  flush_thread_ = new FlushThread(this);
+  return pink::RetCode::kSuccess == flush_thread_->StartThread();
+}
+
+void ZPAsyncLogger::Stop() {
+  sync_ = true;
+  delete flush_thread_;
+  flush_thread_ = NULL;
+  Drain();
+  wrapped_->Flush();
+}
+
+// After the ones queued, which is required by FATAL since process aborts
+// right after, and by the ones after Stop
+void ZPAsyncLogger::WriteThrough(bool force_flush, time_t timestamp,
+    const char* message, int message_len) {
+  slash::MutexLock l(&drain_mu_);
+  DrainLocked();
+  wrapped_->Write(force_flush, timestamp, message, message_len);
+}
+
+void ZPAsyncLogger::Write(bool force_flush, time_t timestamp,
+    const char* message, int message_len) {
+  if (sync_) {
+    WriteThrough(force_flush, timestamp, message, message_len);
+    return;
+  }
+  if (message_len > 0 && message[0] == 'F') {
+    WriteThrough(true, timestamp, message, message_len);
+    wrapped_->Flush();
+    return;
+  }
+
+  uint64_t mask = slots_.size() - 1;
+  uint64_t pos = tail_.load(std::memory_order_relaxed);
+  Slot* slot = NULL;
+  while (true) {
+    slot = &slots_[pos & mask];
+    uint64_t seq = slot->seq.load(std::memory_order_acquire);
+    int64_t diff = static_cast<int64_t>(seq - pos);
+    if (diff == 0) {
+      if (tail_.compare_exchange_weak(pos, pos + 1,
+            std::memory_order_relaxed)) {
+        break;
+      }
+    } else if (diff < 0) {
+      // Ring is full
+      dropped_++;
+      return;
+    } else {
+      pos = tail_.load(std::memory_order_relaxed);
+    }
+  }
+
+  slot->force_flush = force_flush;
+  slot->timestamp = timestamp;
+  slot->message.assign(message, message_len);
+  slot->seq.store(pos + 1, std::memory_order_release);
+}
+
+void ZPAsyncLogger::Flush() {
+  Drain();
+  wrapped_->Flush();
+}
+
+google::uint32 ZPAsyncLogger::LogSize() {
+  return wrapped_->LogSize();
+}
+
+// Return true if anything is written
+bool ZPAsyncLogger::Drain() {
+  slash::MutexLock l(&drain_mu_);
+  return DrainLocked();
+}
+
+// Required: hold drain_mu_
+bool ZPAsyncLogger::DrainLocked() {
+  uint64_t mask = slots_.size() - 1;
+  bool written = false;
+  while (true) {
+    Slot& slot = slots_[head_ & mask];
+    if (slot.seq.load(std::memory_order_acquire) != head_ + 1) {
+      break;
+    }
+    wrapped_->Write(slot.force_flush, slot.timestamp,
+        slot.message.data(), slot.message.size());
+    // Capacity is kept for the next line
+    slot.message.clear();
+    slot.seq.store(head_ + slots_.size(), std::memory_order_release);
+    head_++;
+    written = true;
+  }
+
+  uint64_t dropped = dropped_.exchange(0);
+  if (dropped > 0) {
+    std::string line = std::to_string(dropped)
+      + " log lines dropped for full queue\n";
+    wrapped_->Write(true, time(NULL), line.data(), line.size());
+    written = true;
+  }
+  return written;
+}
+
+void* ZPAsyncLogger::FlushThread::ThreadMain() {
+  while (!should_stop()) {
+    if (!logger_->Drain()) {
+      usleep(kLogFlushInterval * 1000);
+    }
+  }
+  return NULL;
+}
+
+////// ZPLogLimiter ///// /
+uint64_t ZPLogLimiter::Allow(uint64_t* suppressed) {
+  uint64_t now = slash::NowMicros();
+  uint64_t last = last_us_;
+  if (now < last + kLogLimitInterval * 1000
+      || !last_us_.compare_exchange_strong(last, now)) {
+    suppressed_++;
+    return 0;
+  }
+  *suppressed = suppressed_.exchange(0);
+  return 1;
+}
+
+std::ostream& operator<<(std::ostream& os, const ZPLogSuppressed& s) {
+  if (s.num > 0) {
+    os << "[" << s.num << " suppressed] ";
+  }
+  return os;
+}
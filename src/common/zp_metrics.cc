@@ -0,0 +1,206 @@
+#include "include/zp_metrics.h"
+
+#include <poll.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <glog/logging.h>
+
+#include "include/zp_const.h"
+
+#include "slash/include/env.h"
+
+////// ZPMetrics ///// /
+ZPMetrics::Family* ZPMetrics::GetFamily(const std::string& name) {
+  auto it = families_.find(name);
+  if (it != families_.end()) {
+    return &it->second;
+  }
+  names_.push_back(name);
+  return &families_[name];
+}
+
+void ZPMetrics::Declare(const std::string& name, const std::string& type,
+    const std::string& help) {
+  Family* family = GetFamily(name);
+  family->type = type;
+  family->help = help;
+}
+
+void ZPMetrics::AppendSample(const std::string& name, const Labels& labels,
+    double value, std::string* out) {
+  out->append(name);
+  if (!labels.empty()) {
+    out->append("{");
+    for (size_t i = 0; i < labels.size(); i++) {
+      if (i > 0) {
+        out->append(",");
+      }
+      out->append(labels[i].first + "=\"");
+      for (char c : labels[i].second) {
+        if (c == '"' || c == '\\') {
+          out->push_back('\\');
+          out->push_back(c);
+        } else if (c == '\n') {
+          out->append("\\n");
+        } else {
+          out->push_back(c);
+        }
+      }
+      out->append("\"");
+    }
+    out->append("}");
+  }
+  char buf[32];
+  snprintf(buf, sizeof(buf), " %.17g\n", value);
+  out->append(buf);
+}
+
+void ZPMetrics::Add(const std::string& name, const Labels& labels,
+    double value) {
+  AppendSample(name, labels, value, &GetFamily(name)->samples);
+}
+
+void ZPMetrics::AddHistogram(const std::string& name, const Labels& labels,
+    const uint64_t* bounds, const uint64_t* counts, int num, double sum) {
+  std::string* samples = &GetFamily(name)->samples;
+  Labels bucket_labels(labels);
+  bucket_labels.push_back(std::make_pair("le", ""));
+  uint64_t total = 0;
+  for (int i = 0; i <= num; i++) {
+    total += counts[i];
+    bucket_labels.back().second =
+      (i < num) ? std::to_string(bounds[i]) : "+Inf";
+    AppendSample(name + "_bucket", bucket_labels, total, samples);
+  }
+  AppendSample(name + "_sum", labels, sum, samples);
+  AppendSample(name + "_count", labels, total, samples);
+}
+
+void ZPMetrics::Render(std::string* out) const {
+  for (auto& name : names_) {
+    const Family& family = families_.at(name);
+    if (!family.help.empty()) {
+      out->append("# HELP " + name + " " + family.help + "\n");
+    }
+    if (!family.type.empty()) {
+      out->append("# TYPE " + name + " " + family.type + "\n");
+    }
+    out->append(family.samples);
+  }
+}
+
+////// ZPMetricsServer ///// /
+ZPMetricsServer::ZPMetricsServer(int port,
+    const std::function<void(ZPMetrics*)>& collect)
+  : port_(port),
+  listen_fd_(-1),
+  collect_(collect) {
+    set_thread_name("ZPMetricsServer");
+  }
+
+ZPMetricsServer::~ZPMetricsServer() {
+  StopThread();
+  if (listen_fd_ >= 0) {
+    close(listen_fd_);
+  }
+}
+
+slash::Status ZPMetricsServer::Start() {
+  listen_fd_ = socket(AF_INET, SOCK_STREAM, 0);
+  if (listen_fd_ < 0) {
+    return slash::Status::IOError("Metrics socket failed", strerror(errno));
+  }
+  int yes = 1;
+  setsockopt(listen_fd_, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+
+  struct sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_ANY);
+  addr.sin_port = htons(port_);
+  if (bind(listen_fd_, reinterpret_cast<struct sockaddr*>(&addr),
+        sizeof(addr)) < 0
+      || listen(listen_fd_, 16) < 0) {
+    return slash::Status::IOError("Metrics listen failed", strerror(errno));
+  }
+
+  if (pink::RetCode::kSuccess != StartThread()) {
+    return slash::Status::Corruption("Metrics thread start failed");
+  }
+  return slash::Status::OK();
+}
+
+void* ZPMetricsServer::ThreadMain() {
+  while (!should_stop()) {
+    struct pollfd pfd;
+    pfd.fd = listen_fd_;
+    pfd.events = POLLIN;
+    pfd.revents = 0;
+    // Wake up in time to check should_stop
+    if (poll(&pfd, 1, kMetricsTimeout) <= 0) {
+      continue;
+    }
+    int fd = accept(listen_fd_, NULL, NULL);
+    if (fd < 0) {
+      continue;
+    }
+    HandleConn(fd);
+    close(fd);
+  }
+  return NULL;
+}
+
+void ZPMetricsServer::HandleConn(int fd) {
+  struct timeval tv;
+  tv.tv_sec = kMetricsTimeout / 1000;
+  tv.tv_usec = (kMetricsTimeout % 1000) * 1000;
+  setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+  setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+
+  // Only the request line matters
+  std::string request;
+  char buf[1024];
+  while (request.find("\r\n\r\n") == std::string::npos
+      && request.size() < 8192) {
+    ssize_t n = read(fd, buf, sizeof(buf));
+    if (n <= 0) {
+      break;
+    }
+    request.append(buf, n);
+  }
+
+  std::string status = "200 OK";
+  std::string body;
+  if (request.compare(0, 13, "GET /metrics ") == 0
+      || request.compare(0, 6, "GET / ") == 0) {
+    ZPMetrics metrics;
+    collect_(&metrics);
+    metrics.Render(&body);
+  } else {
+    status = "404 Not Found";
+    body = "Not Found\n";
+  }
+
+  std::string response = "HTTP/1.1 " + status + "\r\n"
+    "Content-Type: text/plain; version=0.0.4\r\n"
+    "Content-Length: " + std::to_string(body.size()) + "\r\n"
+    "Connection: close\r\n\r\n" + body;
+  size_t written = 0;
+  while (written < response.size()) {
+    ssize_t n = write(fd, response.data() + written,
+        response.size() - written);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      LOG(WARNING) << "Metrics response write failed, errno: " << errno;
+      return;
+    }
+    written += n;
+  }
+}
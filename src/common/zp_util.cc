@@ -4,6 +4,7 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
+#include <string.h>
 
 #include "include/zp_const.h"
 
@@ -72,7 +73,12 @@ Statistic::Statistic()
       read_min_latency(0),
       write_max_latency(0),
       write_avg_latency(0),
-      write_min_latency(0) {
+      write_min_latency(0),
+      expired(0),
+      read_latency_sum(0),
+      write_latency_sum(0) {
+  memset(read_latency_hist, 0, sizeof(read_latency_hist));
+  memset(write_latency_hist, 0, sizeof(write_latency_hist));
 }
 
 Statistic::Statistic(const Statistic& stat)
@@ -89,7 +95,14 @@ Statistic::Statistic(const Statistic& stat)
       read_min_latency(stat.read_min_latency),
       write_max_latency(stat.write_max_latency),
       write_avg_latency(stat.write_avg_latency),
-      write_min_latency(stat.write_min_latency) {
+      write_min_latency(stat.write_min_latency),
+      expired(stat.expired),
+      read_latency_sum(stat.read_latency_sum),
+      write_latency_sum(stat.write_latency_sum) {
+  memcpy(read_latency_hist, stat.read_latency_hist,
+      sizeof(read_latency_hist));
+  memcpy(write_latency_hist, stat.write_latency_hist,
+      sizeof(write_latency_hist));
 }
 
 void Statistic::Reset() {
@@ -107,6 +120,11 @@ void Statistic::Reset() {
   write_max_latency = 0;
   write_avg_latency = 0;
   write_min_latency = 0;
+  expired = 0;
+  memset(read_latency_hist, 0, sizeof(read_latency_hist));
+  memset(write_latency_hist, 0, sizeof(write_latency_hist));
+  read_latency_sum = 0;
+  write_latency_sum = 0;
 }
 
 void Statistic::Add(const Statistic& stat) {
@@ -115,6 +133,13 @@ void Statistic::Add(const Statistic& stat) {
   last_qps += stat.last_qps;
   used_disk += stat.used_disk;
   free_disk += stat.free_disk;
+  expired += stat.expired;
+  for (int i = 0; i <= kLatencyBucketNum; i++) {
+    read_latency_hist[i] += stat.read_latency_hist[i];
+    write_latency_hist[i] += stat.write_latency_hist[i];
+  }
+  read_latency_sum += stat.read_latency_sum;
+  write_latency_sum += stat.write_latency_sum;
 }
 
 void Statistic::Dump() {
@@ -22,6 +22,7 @@
 #include "slash/include/env.h"
 #include "include/zp_util.h"
 #include "include/zp_conf.h"
+#include "include/zp_log.h"
 #include "src/meta/zp_meta_server.h"
 
 ZpConf *g_zp_conf;
@@ -35,12 +36,14 @@ static void GlogInit() {
     slash::CreatePath(g_zp_conf->log_path());
   }
 
-  FLAGS_alsologtostderr = true;
+  // Nowhere to write once daemonized
+  FLAGS_alsologtostderr = !g_zp_conf->daemonize();
 
   FLAGS_log_dir = g_zp_conf->log_path();
   FLAGS_minloglevel = 0;
   FLAGS_max_log_size = 1800;
   ::google::InitGoogleLogging("zp");
+  ZPLogInit();
 }
 
 static void IntSigHandle(const int sig) {
@@ -135,6 +138,7 @@ int main(int argc, char** argv) {
     unlink(g_zp_conf->pid_file().c_str());
   }
   delete g_zp_conf;
+  ZPLogShutdown();
   ::google::ShutdownGoogleLogging();
 
   printf("Exit\n");
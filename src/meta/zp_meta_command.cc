@@ -374,3 +374,28 @@ void RemoveNodesCmd::Do(const google::protobuf::Message *req,
     response->set_msg(s.ToString());
   }
 }
+
+void SetQuotaCmd::Do(const google::protobuf::Message *req,
+    google::protobuf::Message *res, void* partition) const {
+  const ZPMeta::MetaCmd* request = static_cast<const ZPMeta::MetaCmd*>(req);
+  ZPMeta::MetaCmdResponse* response
+    = static_cast<ZPMeta::MetaCmdResponse*>(res);
+  response->set_type(ZPMeta::Type::SETQUOTA);
+
+  const ZPMeta::MetaCmd_SetQuota& set_quota = request->set_quota();
+  if (set_quota.name().empty()) {
+    response->set_code(ZPMeta::StatusCode::ERROR);
+    response->set_msg("TableName cannot be empty");
+    return;
+  }
+
+  Status s = g_meta_server->SetTableQuota(set_quota.name(),
+      set_quota.quota());
+  if (s.ok()) {
+    response->set_code(ZPMeta::StatusCode::OK);
+    response->set_msg("SetQuota OK!");
+  } else {
+    response->set_code(ZPMeta::StatusCode::ERROR);
+    response->set_msg(s.ToString());
+  }
+}
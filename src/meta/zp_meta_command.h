@@ -157,4 +157,14 @@ class RemoveNodesCmd : public Cmd  {
       google::protobuf::Message *res, void* partition = NULL) const;
 };
 
+class SetQuotaCmd : public Cmd  {
+ public:
+  explicit SetQuotaCmd(int flag) : Cmd(flag, kSetQuotaCmd) {}
+  virtual std::string name() const  {
+    return "SetQuota";
+  }
+  virtual void Do(const google::protobuf::Message *req,
+      google::protobuf::Message *res, void* partition = NULL) const;
+};
+
 #endif  // SRC_META_ZP_META_COMMAND_H_
@@ -299,6 +299,16 @@ Status ZPMetaInfoStoreSnap::RemoveTable(const std::string& table) {
   return Status::OK();
 }
 
+Status ZPMetaInfoStoreSnap::SetTableQuota(const std::string& table,
+    const ZPMeta::TableQuota& quota) {
+  if (tables_.find(table) == tables_.end()) {
+    return Status::NotFound("Table not exist");
+  }
+  tables_[table].mutable_quota()->CopyFrom(quota);
+  table_changed_[table] = true;
+  return Status::OK();
+}
+
 void ZPMetaInfoStoreSnap::RefreshTableWithNodeAlive() {
   std::string ip_port;
   for (auto& table : tables_) {
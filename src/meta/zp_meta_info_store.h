@@ -78,6 +78,8 @@ class ZPMetaInfoStoreSnap   {
         const ZPMeta::PState& target_s);
     Status AddTable(const ZPMeta::Table& table);
     Status RemoveTable(const std::string& table);
+    Status SetTableQuota(const std::string& table,
+        const ZPMeta::TableQuota& quota);
     void RefreshTableWithNodeAlive();
 
  private:
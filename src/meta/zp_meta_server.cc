@@ -35,6 +35,7 @@
 ZPMetaServer::ZPMetaServer()
   : should_exit_(false),
   server_thread_(NULL),
+  metrics_server_(NULL),
   role_(MetaRole::kNone) {
   LOG(INFO) << "ZPMetaServer start initialization";
 
@@ -76,9 +77,16 @@ ZPMetaServer::ZPMetaServer()
       nullptr);
   server_thread_->set_thread_name("ZPMetaDispatch");
   server_thread_->set_keepalive_timeout(kKeepAlive);
+
+  // Metrics for prometheus
+  if (g_zp_conf->metrics_port() > 0) {
+    metrics_server_ = new ZPMetricsServer(g_zp_conf->metrics_port(),
+        [this](ZPMetrics* metrics) { CollectMetrics(metrics); });
+  }
 }
 
 ZPMetaServer::~ZPMetaServer() {
+  delete metrics_server_;
   if (server_thread_ != NULL) {
     server_thread_->StopThread();
   }
@@ -129,6 +137,14 @@ void ZPMetaServer::Start() {
   LOG(INFO) << "Start server thread succ: " << std::hex
     << server_thread_->thread_id(); 
 
+  if (metrics_server_ != NULL) {
+    Status s = metrics_server_->Start();
+    if (!s.ok()) {
+      // Serve without metrics
+      LOG(WARNING) << "Metrics server start failed, " << s.ToString();
+    }
+  }
+
   while (!should_exit_) {
     DoTimingTask();
     int sleep_count = kMetaCronWaitCount;
@@ -360,6 +376,39 @@ Status ZPMetaServer::RemoveNodes(
   return Status::OK();
 }
 
+Status ZPMetaServer::SetTableQuota(const std::string& table,
+    const ZPMeta::TableQuota& quota) {
+  if (!TableExist(table)) {
+    return Status::InvalidArgument("Table not exist");
+  }
+  if (quota.read_ops() < 0 || quota.write_ops() < 0
+      || quota.read_bytes() < 0 || quota.write_bytes() < 0) {
+    return Status::InvalidArgument("Quota should not be negative");
+  }
+
+  UpdateTask task;
+  task.op = kOpSetQuota;
+  task.print_args_text = [table, quota]() {
+    std::ostringstream out;
+    out << "task: SetQuota, when: SetTableQuota, table: " << table
+        << ", read_ops: " << quota.read_ops()
+        << ", write_ops: " << quota.write_ops()
+        << ", read_bytes: " << quota.read_bytes()
+        << ", write_bytes: " << quota.write_bytes();
+    return out.str();
+  };
+  task.sargs[0] = table;
+  quota.SerializeToString(&task.sargs[1]);
+
+  Status s = update_thread_->PendingUpdate(task);
+  if (!s.ok()) {
+    LOG(WARNING) << "Pending task failed, " << s.ToString() << ", "
+      << task.print_args_text();
+    return s;
+  }
+  return Status::OK();
+}
+
 Status ZPMetaServer::ActiveAllPartition() {
   std::set<std::string> table_list;
   Status s = info_store_->GetTableList(&table_list);
@@ -998,6 +1047,11 @@ void ZPMetaServer::InitClientCmdTable() {
   Cmd* remove_nodes_ptr = new RemoveNodesCmd(kCmdFlagsWrite | kCmdFlagsRedirect);
   cmds_.insert(std::pair<int, Cmd*>(static_cast<int>(ZPMeta::Type::REMOVENODES),
         remove_nodes_ptr));
+
+  // SetQuota Command
+  Cmd* set_quota_ptr = new SetQuotaCmd(kCmdFlagsWrite | kCmdFlagsRedirect);
+  cmds_.insert(std::pair<int, Cmd*>(static_cast<int>(ZPMeta::Type::SETQUOTA),
+        set_quota_ptr));
 }
 
 
@@ -1043,3 +1097,31 @@ void ZPMetaServer::DoTimingTask() {
     << " ServerCurrentQps: " << statistic.last_qps
     << " Role: " << MetaRoleMsg[role_];
 }
+
+void ZPMetaServer::CollectMetrics(ZPMetrics* metrics) {
+  metrics->Declare("zp_meta_epoch", "gauge", "Current meta epoch");
+  metrics->Add("zp_meta_epoch", {}, info_store_->epoch());
+  metrics->Declare("zp_meta_leader", "gauge", "Whether this meta is leader");
+  metrics->Add("zp_meta_leader", {}, IsLeader() ? 1 : 0);
+  metrics->Declare("zp_meta_queries_total", "counter", "Commands executed");
+  metrics->Add("zp_meta_queries_total", {}, statistic.query_num);
+  metrics->Declare("zp_meta_qps", "gauge", "Commands per second");
+  metrics->Add("zp_meta_qps", {}, statistic.last_qps);
+
+  std::set<std::string> tables;
+  info_store_->GetTableList(&tables);
+  metrics->Declare("zp_meta_tables", "gauge", "Number of tables");
+  metrics->Add("zp_meta_tables", {}, tables.size());
+
+  std::unordered_map<std::string, NodeInfo> nodes;
+  info_store_->GetAllNodes(&nodes);
+  int up = 0;
+  for (auto& node : nodes) {
+    if (node.second.last_alive_time > 0) {
+      up++;
+    }
+  }
+  metrics->Declare("zp_meta_nodes", "gauge", "Number of data nodes");
+  metrics->Add("zp_meta_nodes", {{"state", "up"}}, up);
+  metrics->Add("zp_meta_nodes", {{"state", "down"}}, nodes.size() - up);
+}
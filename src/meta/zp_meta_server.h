@@ -28,6 +28,7 @@
 
 #include "include/zp_conf.h"
 #include "include/zp_const.h"
+#include "include/zp_metrics.h"
 #include "src/meta/zp_meta_command.h"
 #include "src/meta/zp_meta_client_conn.h"
 #include "src/meta/zp_meta_info_store.h"
@@ -145,6 +146,8 @@ class ZPMetaServer  {
   Status GetMetaStatus(ZPMeta::MetaCmdResponse_MetaStatus* ms);
   bool IsCharged(const std::string& table, int pnum, const ZPMeta::Node& node);
   Status RemoveNodes(const ZPMeta::MetaCmd_RemoveNodes& remove_nodes_cmd);
+  Status SetTableQuota(const std::string& table,
+      const ZPMeta::TableQuota& quota);
 
   // Migrate related
   Status Migrate(int epoch, const std::vector<ZPMeta::RelationCmdUnit>& diffs);
@@ -169,6 +172,7 @@ class ZPMetaServer  {
   ZPMetaClientConnFactory* conn_factory_;
   ZPMetaUpdateThread* update_thread_;
   ZPMetaConditionCron* condition_cron_;
+  ZPMetricsServer* metrics_server_;  // NULL if metrics_port is 0
   void DoTimingTask();
 
   // Floyd related
@@ -202,6 +206,7 @@ class ZPMetaServer  {
   // Statistic related
   QueryStatistic statistic;
   void ResetLastSecQueryNum();
+  void CollectMetrics(ZPMetrics* metrics);
 };
 
 #endif  // SRC_META_ZP_META_SERVER_H_
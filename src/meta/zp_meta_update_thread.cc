@@ -107,6 +107,7 @@ Status ZPMetaUpdateThread::ApplyUpdates(
   std::string left_node;
   ZPMeta::Table table;
   ZPMeta::MetaCmd_RemoveNodes remove_nodes_cmd;
+  ZPMeta::TableQuota quota;
   int partition;
 
   for (const auto cur_task : task_deque) {
@@ -177,6 +178,11 @@ Status ZPMetaUpdateThread::ApplyUpdates(
         s = info_store_snap.ChangePState(table_name, partition,
             ZPMeta::PState::SLOWDOWN);
         break;
+      case ZPMetaUpdateOP::kOpSetQuota:
+        table_name = cur_task.sargs[0];
+        quota.ParseFromString(cur_task.sargs[1]);
+        s = info_store_snap.SetTableQuota(table_name, quota);
+        break;
       default:
         s = Status::Corruption("Unknown task type");
     }
@@ -39,7 +39,8 @@ enum ZPMetaUpdateOP : unsigned int {
   kOpSetMaster,
   kOpSetActive,  // ACTIVE the partition
   kOpSetStuck,  // Stuck the partition
-  kOpSetSlowdown  // Slowdown the partition
+  kOpSetSlowdown,  // Slowdown the partition
+  kOpSetQuota  // Change limits of the table
 };
 
 const int MAX_ARGS = 8;
@@ -0,0 +1,137 @@
+// Copyright 2017 Qihoo
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http:// www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include "src/node/zp_binlog_ack_thread.h"
+
+#include <glog/logging.h>
+#include "include/zp_log.h"
+#include "src/node/zp_data_server.h"
+#include "src/node/zp_data_partition.h"
+
+extern ZPDataServer* zp_data_server;
+
+ZPBinlogAckThread::ZPBinlogAckThread() {
+  bg_thread_ = new pink::BGThread(1024 * 1024 * 256);
+  bg_thread_->set_thread_name("ZPDataBinlogAck");
+}
+
+ZPBinlogAckThread::~ZPBinlogAckThread() {
+  bg_thread_->StopThread();
+  delete bg_thread_;
+  for (auto &kv : client_pool_) {
+    kv.second->Close();
+    delete kv.second;
+  }
+  LOG(INFO) << " BinlogAck thread " << pthread_self() << " exit!!!";
+}
+
+void ZPBinlogAckThread::AckTaskSchedule(const std::string& table,
+    int partition_id, uint64_t delay) {
+  slash::MutexLock l(&bg_thread_protector_);
+  bg_thread_->StartThread();
+  AckTaskArg *targ = new AckTaskArg(this, table, partition_id);
+  if (delay == 0) {  // no delay
+    bg_thread_->Schedule(&DoAckTask, static_cast<void*>(targ));
+  } else {
+    bg_thread_->DelaySchedule(delay, &DoAckTask, static_cast<void*>(targ));
+  }
+}
+
+void ZPBinlogAckThread::DoAckTask(void* arg) {
+  AckTaskArg* targ = static_cast<AckTaskArg*>(arg);
+  (targ->thread)->AckTask(targ->table_name, targ->partition_id);
+  delete targ;
+}
+
+void ZPBinlogAckThread::AckTask(const std::string& table_name,
+    int partition_id) {
+  std::shared_ptr<Partition> partition =
+    zp_data_server->GetTablePartitionById(table_name, partition_id);
+  if (!partition) {
+    return;
+  }
+
+  Node master;
+  BinlogOffset boffset;
+  BinlogStamp stamp;
+  if (!partition->GetBinlogAck(&master, &boffset, &stamp)) {
+    // Not a connected slave any more
+    return;
+  }
+
+  client::SyncRequest request;
+  request.set_sync_type(client::SyncType::ACK);
+  request.set_epoch(zp_data_server->meta_epoch());
+  client::Node* node = request.mutable_from();
+  node->set_ip(zp_data_server->local_ip());
+  node->set_port(zp_data_server->local_port());
+  client::SyncOffset* sync_offset = request.mutable_sync_offset();
+  sync_offset->set_partition(partition_id);
+  sync_offset->set_filenum(boffset.filenum);
+  sync_offset->set_offset(boffset.offset);
+  if (stamp.seq > 0) {
+    request.mutable_stamp()->set_seq(stamp.seq);
+    request.mutable_stamp()->set_time_us(stamp.time_us);
+  }
+  client::BinlogAck* ack = request.mutable_binlog_ack();
+  ack->set_table_name(table_name);
+  ack->set_partition_id(partition_id);
+
+  Node peer(master.ip, master.port + kPortShiftSync);
+  pink::PinkCli* cli = GetConnection(peer);
+  if (cli == NULL) {
+    partition->RetryBinlogAck();
+    return;
+  }
+  Status s = cli->Send(&request);
+  if (!s.ok()) {
+    LOG_LIMITED(WARNING) << "BinlogAck send failed, Partition "
+      << table_name << "_" << partition_id << " to " << peer
+      << ", caz " << s.ToString();
+    DropConnection(peer);
+    partition->RetryBinlogAck();
+  }
+}
+
+pink::PinkCli* ZPBinlogAckThread::GetConnection(const Node& node) {
+  std::string ip_port = slash::IpPortString(node.ip, node.port);
+  pink::PinkCli* cli;
+  auto iter = client_pool_.find(ip_port);
+  if (iter == client_pool_.end()) {
+    cli = pink::NewPbCli();
+    cli->set_connect_timeout(1500);
+    Status s = cli->Connect(node.ip, node.port);
+    if (!s.ok()) {
+      LOG_LIMITED(WARNING) << "ZPBinlogAck Thread connect node: " << ip_port
+        <<" failed caz" << s.ToString();
+      delete cli;
+      return NULL;
+    }
+    cli->set_send_timeout(1000);
+    client_pool_[ip_port] = cli;
+  } else {
+    cli = iter->second;
+  }
+  return cli;
+}
+
+void ZPBinlogAckThread::DropConnection(const Node& node) {
+  std::string ip_port = slash::IpPortString(node.ip, node.port);
+  auto iter = client_pool_.find(ip_port);
+  if (iter != client_pool_.end()) {
+    pink::PinkCli* cli = iter->second;
+    cli->Close();
+    delete cli;
+    client_pool_.erase(iter);
+  }
+}
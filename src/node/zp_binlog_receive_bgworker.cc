@@ -58,7 +58,7 @@ void ZPBinlogReceiveBgWorker::DoBinlogReceiveTask(void* task) {
     case client::SyncType::CMD:
       partition->DoBinlogCommand(
           option,
-          task_ptr->cmd, task_ptr->request);
+          task_ptr->cmd, task_ptr->request, task_ptr->item);
       break;
     case client::SyncType::SKIP:
       partition->DoBinlogSkip(
@@ -68,7 +68,9 @@ void ZPBinlogReceiveBgWorker::DoBinlogReceiveTask(void* task) {
     case client::SyncType::LEASE:
       partition->DoBinlogLeaseRenew(
           option,
-          task_ptr->i);
+          task_ptr->i,
+          task_ptr->flag,
+          task_ptr->recv_us);
       break;
     default:
       LOG(WARNING) << "Unknown binlog sync type: "
@@ -22,18 +22,25 @@ struct ZPBinlogReceiveTask {
   PartitionSyncOption option;
   const Cmd* cmd;
   client::CmdRequest request;
+  std::string item;  // binlog item from master, written as it is
   uint64_t i;
+  bool flag;
+  uint64_t recv_us;  // when it reached us, before waiting in queue
 
   ZPBinlogReceiveTask(const PartitionSyncOption &opt,
       const Cmd* c, const client::CmdRequest &req)
     : option(opt),
     cmd(c),
-    request(req) {}
+    request(req),
+    flag(false),
+    recv_us(0) {}
 
   ZPBinlogReceiveTask(const PartitionSyncOption &opt,
-      uint64_t integer)
+      uint64_t integer, bool f = false, uint64_t recv = 0)
     : option(opt),
-    i(integer) {}
+    i(integer),
+    flag(f),
+    recv_us(recv) {}
 };
 
 class ZPBinlogReceiveBgWorker {
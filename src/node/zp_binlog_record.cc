@@ -0,0 +1,113 @@
+// Copyright 2017 Qihoo
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http:// www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include "src/node/zp_binlog_record.h"
+
+#include <time.h>
+
+#include "slash/include/slash_coding.h"
+
+#include "include/zp_const.h"
+
+bool EncodeBinlogRecord(const client::CmdRequest& request,
+    std::string* content) {
+  content->clear();
+  if (request.has_trace()) {
+    // Trace goes along with the full request
+    return false;
+  }
+  if (request.type() == client::Type::SET) {
+    const client::CmdRequest_Set& set = request.set();
+    content->reserve(1 + 5 + set.key().size() + 5 + set.value().size()
+        + (set.has_expire() ? 10 : 0));
+    content->push_back(static_cast<char>(kBinlogOpSet
+          | (set.has_expire() ? kBinlogOpExpire : 0)));
+    slash::PutLengthPrefixedSlice(content, set.key());
+    slash::PutLengthPrefixedSlice(content, set.value());
+    if (set.has_expire()) {
+      slash::PutVarint32(content, static_cast<uint32_t>(set.expire().ttl()));
+      slash::PutVarint32(content, static_cast<uint32_t>(time(NULL)));
+    }
+    return true;
+  } else if (request.type() == client::Type::DEL) {
+    content->reserve(1 + 5 + request.del().key().size());
+    content->push_back(static_cast<char>(kBinlogOpDel));
+    slash::PutLengthPrefixedSlice(content, request.del().key());
+    return true;
+  }
+  return false;
+}
+
+bool DecodeBinlogRecord(const Slice& content, BinlogRecord* record) {
+  Slice input = content;
+  if (input.empty()) {
+    return false;
+  }
+  uint8_t op = static_cast<uint8_t>(input[0]);
+  input.remove_prefix(1);
+  record->op = op & kBinlogOpMask;
+  record->has_expire = (op & kBinlogOpExpire) != 0;
+  record->value.clear();
+  record->ttl = 0;
+  record->base = 0;
+  if (!slash::GetLengthPrefixedSlice(&input, &record->key)) {
+    return false;
+  }
+  if (record->op == kBinlogOpSet) {
+    if (!slash::GetLengthPrefixedSlice(&input, &record->value)) {
+      return false;
+    }
+  } else if (record->op != kBinlogOpDel) {
+    return false;
+  }
+  if (record->has_expire) {
+    uint32_t ttl = 0, base = 0;
+    if (!slash::GetVarint32(&input, &ttl)
+        || !slash::GetVarint32(&input, &base)) {
+      return false;
+    }
+    record->ttl = static_cast<int32_t>(ttl);
+    record->base = static_cast<int32_t>(base);
+  }
+  return input.empty();
+}
+
+bool ParseBinlogContent(const Slice& content, int flags,
+    const std::string& table_name, client::CmdRequest* request) {
+  if (!(flags & kBinlogItemCompact)) {
+    return request->ParseFromArray(content.data(), content.size());
+  }
+
+  BinlogRecord record;
+  if (!DecodeBinlogRecord(content, &record)) {
+    return false;
+  }
+  request->Clear();
+  if (record.op == kBinlogOpSet) {
+    request->set_type(client::Type::SET);
+    client::CmdRequest_Set* set = request->mutable_set();
+    set->set_table_name(table_name);
+    set->set_key(record.key.data(), record.key.size());
+    set->set_value(record.value.data(), record.value.size());
+    if (record.has_expire) {
+      set->mutable_expire()->set_ttl(record.ttl);
+      set->mutable_expire()->set_base(record.base);
+    }
+  } else {
+    request->set_type(client::Type::DEL);
+    client::CmdRequest_Del* del = request->mutable_del();
+    del->set_table_name(table_name);
+    del->set_key(record.key.data(), record.key.size());
+  }
+  return true;
+}
@@ -0,0 +1,58 @@
+// Copyright 2017 Qihoo
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http:// www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#ifndef SRC_NODE_ZP_BINLOG_RECORD_H_
+#define SRC_NODE_ZP_BINLOG_RECORD_H_
+
+#include <string>
+
+#include "slash/include/slash_slice.h"
+
+#include "src/node/client.pb.h"
+
+using slash::Slice;
+
+// Compact binlog content of a single key write, used instead of the
+// serialized CmdRequest when kBinlogItemCompact is set in the item.
+// Table name is left out since binlog is kept per partition:
+//   Op(1 byte) | Key(varint32 length prefixed)
+//   | Value(varint32 length prefixed), for Set only
+//   | Ttl(varint32) | Base(varint32), if kBinlogOpExpire in Op
+enum BinlogOp {
+  kBinlogOpSet = 1,
+  kBinlogOpDel = 2,
+};
+const uint8_t kBinlogOpMask = 0x7f;
+const uint8_t kBinlogOpExpire = 0x80;
+
+// Slices point into the decoded content
+struct BinlogRecord {
+  uint8_t op;
+  Slice key;
+  Slice value;
+  bool has_expire;
+  int32_t ttl;
+  int32_t base;
+};
+
+// Return false if request could not be compact, such as a traced one,
+// expire base is set to now as SetCmd::GenerateLog does
+bool EncodeBinlogRecord(const client::CmdRequest& request,
+    std::string* content);
+bool DecodeBinlogRecord(const Slice& content, BinlogRecord* record);
+
+// Parse content of binlog item in either format
+bool ParseBinlogContent(const Slice& content, int flags,
+    const std::string& table_name, client::CmdRequest* request);
+
+#endif  // SRC_NODE_ZP_BINLOG_RECORD_H_
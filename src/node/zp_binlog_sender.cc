@@ -21,6 +21,7 @@
 #include "slash/include/env.h"
 
 #include "include/zp_const.h"
+#include "include/zp_log.h"
 #include "src/node/zp_data_server.h"
 #include "src/node/zp_data_partition.h"
 
@@ -64,6 +65,7 @@ ZPBinlogSendTask::ZPBinlogSendTask(uint64_t seq, const std::string &table,
   filenum_(ifilenum),
   offset_(ioffset),
   process_error_time_(0),
+  caught_up_(false),
   pre_filenum_(0),
   pre_offset_(0),
   pre_has_content_(false),
@@ -84,25 +86,52 @@ ZPBinlogSendTask::~ZPBinlogSendTask() {
 }
 
 Status ZPBinlogSendTask::Init() {
-  std::string confile = NewFileName(binlog_filename_, filenum_);
-  if (!slash::NewSequentialFile(confile, &queue_).ok()) {
-    return Status::IOError("ZPBinlogSendTask Init new sequtial file failed");
+  Status s = NewReader(filenum_);
+  if (!s.ok()) {
+    return Status::IOError("ZPBinlogSendTask Init new reader failed");
   }
-  reader_ = new BinlogReader(queue_);
-  Status s = reader_->Seek(offset_);
+  s = reader_->Seek(offset_);
+  if (!s.ok()) {
+    return s;
+  }
+  return Status::OK();
+}
+
+// Rolled binlog file is never written again, read it by mapping
+Status ZPBinlogSendTask::NewReader(uint32_t filenum) {
+  delete reader_;
+  reader_ = NULL;
+  delete queue_;
+  queue_ = NULL;
+
+  std::string confile = NewFileName(binlog_filename_, filenum);
+  if (slash::FileExists(NewFileName(binlog_filename_, filenum + 1))) {
+    // Lagging by more than a whole file, the file is read only for
+    // this catch-up, keep it out of page cache
+    bool cold = slash::FileExists(NewFileName(binlog_filename_, filenum + 2));
+    Status s = BinlogReader::CreateMapped(confile, cold, &reader_);
+    if (s.ok()) {
+      return s;
+    }
+    LOG(WARNING) << "Failed to map binlog " << confile << ", read it as "
+      << "sequential file instead, Error: " << s.ToString();
+  }
+  Status s = slash::NewSequentialFile(confile, &queue_);
   if (!s.ok()) {
     return s;
   }
+  reader_ = new BinlogReader(queue_);
   return Status::OK();
 }
 
 // Return Status::OK if has something to be send
 Status ZPBinlogSendTask::ProcessTask() {
-  if (reader_ == NULL || queue_ == NULL) {
+  if (reader_ == NULL) {
     return Status::InvalidArgument("Error Task");
   }
 
   // Check task position
+  caught_up_ = false;
   BinlogOffset boffset;
   std::shared_ptr<Partition> partition =
     zp_data_server->GetTablePartitionById(table_name_, partition_id_);
@@ -113,6 +142,7 @@ Status ZPBinlogSendTask::ProcessTask() {
   partition->GetBinlogOffsetWithLock(&boffset);
   if (filenum_ == boffset.filenum && offset_ == boffset.offset) {
     // No more binlog item in current task, switch to others
+    caught_up_ = true;
     return Status::EndFile("no more binlog item");
   }
   // LOG(INFO) << "Processing a task" << table_name_
@@ -120,7 +150,7 @@ Status ZPBinlogSendTask::ProcessTask() {
   RecordPreOffset();
 
   uint64_t consume_len = 0;
-  Status s = reader_->Consume(&consume_len, &pre_content_);
+  Status s = reader_->Consume(&consume_len, &pre_content_, &pre_item_);
   if (s.IsEndFile()) {
     // Roll to next File
     std::string confile = NewFileName(binlog_filename_, filenum_ + 1);
@@ -128,19 +158,13 @@ Status ZPBinlogSendTask::ProcessTask() {
     if (slash::FileExists(confile)) {
       LOG(INFO) << "BinlogSender to " << node_ << " roll to new binlog "
         << confile << ", Partition: " << table_name_ << "_" << partition_id_;
-      delete reader_;
-      reader_ = NULL;
-      delete queue_;
-      queue_ = NULL;
-
-      s = slash::NewSequentialFile(confile, &(queue_));
+      s = NewReader(filenum_ + 1);
       if (!s.ok()) {
         LOG(WARNING) << "Failed to roll to next binlog file:" << (filenum_ + 1)
           << " Error:" << s.ToString() << ", Partition: " << table_name_
           << "_" << partition_id_ << ", Send to " << node_;
         return s;
       }
-      reader_ = new BinlogReader(queue_);
       filenum_++;
       offset_ = 0;
       return ProcessTask();
@@ -151,11 +175,17 @@ Status ZPBinlogSendTask::ProcessTask() {
       return s;
     }
   } else if (s.IsIncomplete()) {
-    LOG(WARNING) << "ZPBinlogSendTask Consume Incomplete record: "
+    LOG_LIMITED(WARNING) << "ZPBinlogSendTask Consume Incomplete record: "
       << s.ToString() << ", table: " << table_name_ << ", partition:"
       << partition_id_ << ", Send to " << node_;
+  } else if (s.IsCorruption()) {
+    LOG_LIMITED(ERROR) << "ZPBinlogSendTask found corrupted record: "
+      << s.ToString() << ", table: " << table_name_ << ", partition:"
+      << partition_id_ << ", binlog: " << filenum_ << ":" << offset_
+      << ", Send to " << node_ << ", skip to next block";
+    reader_->SkipNextBlock(&consume_len);
   } else if (!s.ok()) {
-    LOG(WARNING) << "ZPBinlogSendTask failed to Consume: " << s.ToString()
+    LOG_LIMITED(WARNING) << "ZPBinlogSendTask failed to Consume: " << s.ToString()
       << ", table: " << table_name_ << ", partition:" << partition_id_
       << ", Send to " << node_ << ", skip to next block";
     reader_->SkipNextBlock(&consume_len);
@@ -184,6 +214,9 @@ void ZPBinlogSendTask::BuildLeaseSyncRequest(int64_t lease_time,
   lease->set_table_name(table_name_);
   lease->set_partition_id(partition_id_);
   lease->set_lease(lease_time);
+  // Peer has received all binlog we have, which means all items before
+  // the lease have been applied when it's handled by peer
+  lease->set_caught_up(caught_up_);
 }
 
 // Build CMD or SKIP SyncRequest by ZPBinlogSendTask
@@ -200,11 +233,19 @@ void ZPBinlogSendTask::BuildCommonSyncRequest(client::SyncRequest *msg) const {
   // Different part
   if (pre_has_content_) {
     msg->set_sync_type(client::SyncType::CMD);
-    client::CmdRequest *req_ptr = msg->mutable_request();
-    client::CmdRequest req;
-    assert(!pre_content_.empty());
-    req.ParseFromString(pre_content_);
-    req_ptr->CopyFrom(req);
+    assert(!pre_item_.empty());
+    BinlogStamp stamp;
+    Slice content = DecodeBinlogItem(pre_item_, &stamp);
+    if (stamp.seq > 0) {
+      // Shipped as it is, parsed and kept by slave without serialize again
+      msg->set_binlog_item(pre_item_.data(), pre_item_.size());
+      msg->set_table_name(table_name_);
+      // Slave keeps the same stamp, so that binlog stays the same
+      msg->mutable_stamp()->set_seq(stamp.seq);
+      msg->mutable_stamp()->set_time_us(stamp.time_us);
+    } else {
+      msg->mutable_request()->ParseFromArray(content.data(), content.size());
+    }
   } else {
     msg->set_sync_type(client::SyncType::SKIP);
     client::BinlogSkip* skip = msg->mutable_binlog_skip();
@@ -412,7 +453,7 @@ bool ZPBinlogSendThread::RenewPeerLease(ZPBinlogSendTask* task) {
   task->BuildLeaseSyncRequest(lease_time, &sreq);
   Status s = SendToPeer(task->node(), sreq);
   if (!s.ok()) {
-    LOG(WARNING) << "Failed to send lease to peer " << task->node()
+    LOG_LIMITED(WARNING) << "Failed to send lease to peer " << task->node()
       << ", table:" << task->table_name() << ", partition:"
       << task->partition_id()
       << ", filenum:" << task->pre_filenum()
@@ -522,7 +563,7 @@ void* ZPBinlogSendThread::ThreadMain() {
       } else {
         item_s = SendToPeer(task->node(), sreq);
         if (!item_s.ok()) {
-          LOG(ERROR) << "Failed to send to peer " << task->node()
+          LOG_LIMITED(ERROR) << "Failed to send to peer " << task->node()
             << ", table:" << task->table_name() << ", partition:"
             << task->partition_id()
             << ", filenum:" << task->pre_filenum()
@@ -92,8 +92,11 @@ class ZPBinlogSendTask  {
   uint64_t pre_offset() const {
     return pre_offset_;
   }
-  std::string pre_content() const {
-    return pre_content_;
+  Slice pre_item() const {
+    return pre_item_;
+  }
+  bool caught_up() const {
+    return caught_up_;
   }
 
   Status ProcessTask();
@@ -110,17 +113,22 @@ class ZPBinlogSendTask  {
   uint32_t filenum_;
   uint64_t offset_;
   uint64_t process_error_time_;
-  
+  bool caught_up_;  // last ProcessTask found nothing to send
+
   // Record The last item filenum and offset
   // For sending use later
   uint32_t pre_filenum_;
   uint64_t pre_offset_;
+  // Scratch for item of several fragments
   std::string pre_content_;
+  // Item consumed, which points into the reader or pre_content_
+  Slice pre_item_;
   bool pre_has_content_;
   std::string binlog_filename_;  // Name of the binlog file
   slash::SequentialFile *queue_;
   BinlogReader *reader_;
   Status Init();
+  Status NewReader(uint32_t filenum);
   // Record current filenum and offset in the pre one
   // So that we can know where the last binlog item begin
   void RecordPreOffset() {
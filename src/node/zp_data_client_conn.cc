@@ -13,6 +13,10 @@
 // limitations under the License.
 #include "src/node/zp_data_client_conn.h"
 
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
 #include <glog/logging.h>
 #include <memory>
 #include "src/node/zp_data_server.h"
@@ -28,15 +32,88 @@ ZPDataClientConn::ZPDataClientConn(int fd, std::string ip_port,
 ZPDataClientConn::~ZPDataClientConn() {
 }
 
+// Read all availible data, and deal with every complete request in it.
+// Only used with executor, since responses are written by channel then
+pink::ReadStatus ZPDataClientConn::GetRequest() {
+  if (zp_data_server->data_executor() == NULL) {
+    return pink::PbConn::GetRequest();
+  }
+
+  bool closed = false;
+  char buf[64 * 1024];
+  size_t total = 0;
+  while (total < kClientReadOnce) {
+    ssize_t n = read(fd(), buf, sizeof(buf));
+    if (n > 0) {
+      in_buf_.append(buf, n);
+      total += n;
+      if (static_cast<size_t>(n) < sizeof(buf)) {
+        break;
+      }
+    } else if (n == 0) {
+      // Still deal with the ones already received
+      closed = true;
+      break;
+    } else if (errno == EINTR) {
+      continue;
+    } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+      break;
+    } else {
+      return pink::kReadError;
+    }
+  }
+
+  // Msg is  [ length (int32) | pb_msg (length bytes) ]
+  size_t pos = 0;
+  while (in_buf_.size() - pos >= sizeof(uint32_t)) {
+    uint32_t len = 0;
+    memcpy(&len, in_buf_.data() + pos, sizeof(uint32_t));
+    len = ntohl(len);
+    if (len > kClientMaxFrame) {
+      LOG(WARNING) << "Receive too large request from (" << ip_port()
+        << "), length: " << len;
+      return pink::kFullError;
+    }
+    if (in_buf_.size() - pos - sizeof(uint32_t) < len) {
+      break;
+    }
+    int s = DealFrame(in_buf_.data() + pos + sizeof(uint32_t), len);
+    pos += sizeof(uint32_t) + len;
+    if (s != 0) {
+      return pink::kDealError;
+    }
+  }
+  in_buf_.erase(0, pos);
+
+  if (closed) {
+    return pink::kReadClose;
+  }
+  return in_buf_.empty() ? pink::kReadAll : pink::kReadHalf;
+}
+
 int ZPDataClientConn::DealMessage() {
   set_is_reply(true);
-  int s = DealMessageInternal();
+  int s = DealFrame(rbuf_ + cur_pos_ - header_len_, header_len_);
   res_ = &response_;
   return s;
 }
 
-// Msg is  [ length (int32) | pb_msg (length bytes) ]
-int ZPDataClientConn::DealMessageInternal() {
+int ZPDataClientConn::DealFrame(const char* data, int len) {
+  bool scheduled = false;
+  int s = DealMessageInternal(data, len, &scheduled);
+  if (zp_data_server->data_executor() != NULL) {
+    // All responses go through channel when executor is used,
+    // so that they are in order with the ones in flight
+    set_is_reply(false);
+    if (!scheduled) {
+      channel()->Reply(channel()->NextSequence(), response_);
+    }
+  }
+  return s;
+}
+
+int ZPDataClientConn::DealMessageInternal(const char* data, int len,
+    bool* scheduled) {
   if (!zp_data_server->Availible()) {
     DLOG(WARNING) << "Receive Client command "
       << static_cast<int>(request_.type())
@@ -47,7 +124,7 @@ int ZPDataClientConn::DealMessageInternal() {
     return -1;
   }
 
-  if (!request_.ParseFromArray(rbuf_ + cur_pos_ - header_len_, header_len_)) {
+  if (!request_.ParseFromArray(data, len)) {
     LOG(WARNING) << "Receive Client command, but parse error";
     response_.set_type(request_.type());
     response_.set_code(client::StatusCode::kError);
@@ -68,31 +145,155 @@ int ZPDataClientConn::DealMessageInternal() {
     << ", table=" << cmd->ExtractTable(&request_)
     << " key=" << cmd->ExtractKey(&request_);
 
+  if (request_.has_deadline_us()
+      && slash::NowMicros() > static_cast<uint64_t>(request_.deadline_us())) {
+    // Client has given up, but the connection is still good
+    zp_data_server->PlusExpiredStat(StatType::kClient,
+        cmd->ExtractTable(&request_));
+    response_.set_type(request_.type());
+    response_.set_code(client::StatusCode::kTimeout);
+    response_.set_msg("deadline exceeded");
+    return 0;
+  }
+
+  if (cmd->is_single_paritition()) {
+    ZPTrace::Sample(&request_);
+  }
+
+  // Received bytes go to binlog as they are, unless trace is set above
+  Slice wire;
+  if (cmd->is_write() && !request_.has_trace()) {
+    wire = Slice(data, len);
+  }
+
+  ZPDataExecutor* executor = zp_data_server->data_executor();
+  if (executor != NULL && cmd->type_ == kWaitCmd) {
+    // Parked until replied by slave ack or timer
+    std::shared_ptr<ZPClientChannel> chan = channel();
+    uint64_t seq = chan->NextSequence();
+    static_cast<const WaitCmd*>(cmd)->DoAsync(request_,
+        [chan, seq](const client::CmdResponse& response) {
+          chan->Reply(seq, response);
+        });
+    *scheduled = true;
+    return 0;
+  }
+  if (executor != NULL) {
+    ScheduleCommand(executor, cmd, wire);
+    *scheduled = true;
+    return 0;
+  }
+
+  return ExecuteCommand(cmd, request_, &response_, 0, wire);
+}
+
+std::shared_ptr<ZPClientChannel> ZPDataClientConn::channel() {
+  if (!channel_) {
+    channel_ = std::make_shared<ZPClientChannel>(fd(),
+        zp_data_server->data_executor()->reply_flusher());
+  }
+  return channel_;
+}
+
+struct ZPDataClientConn::ScheduledCommand {
+  std::shared_ptr<ZPClientChannel> chan;
+  uint64_t seq;
+  const Cmd* cmd;
+  client::CmdRequest request;
+  // Read buffer is reused once returned, keep a copy of the bytes,
+  // which is still cheaper than serialize again
+  std::string wire;
+  uint64_t affinity;
+  uint64_t submit_us;
+  uint64_t paced_us;  // turn taken by a paced write
+};
+
+// Hand over to executor, and reply through channel when it's done
+void ZPDataClientConn::ScheduleCommand(ZPDataExecutor* executor,
+    const Cmd* cmd, const Slice& wire) {
+  std::shared_ptr<ScheduledCommand> scmd =
+    std::make_shared<ScheduledCommand>();
+  scmd->chan = channel();
+  scmd->seq = scmd->chan->NextSequence();
+  scmd->cmd = cmd;
+  scmd->request.Swap(&request_);
+  scmd->wire.assign(wire.data(), wire.size());
+  scmd->paced_us = 0;
+
+  // Commands on the same partition prefer the same executor thread
+  const client::CmdRequest* request = &scmd->request;
+  std::string table_name = cmd->ExtractTable(request);
+  uint64_t affinity = std::hash<std::string>()(table_name);
+  if (cmd->is_single_paritition()) {
+    int partition_id = cmd->ExtractPartition(request);
+    if (partition_id < 0) {
+      partition_id = zp_data_server->KeyToPartition(table_name,
+          cmd->ExtractKey(request));
+    }
+    affinity += partition_id;
+  } else {
+    affinity += scmd->seq;
+  }
+  scmd->affinity = affinity;
+
+  scmd->submit_us = slash::NowMicros();
+  scmd->chan->Submit(executor, affinity, cmd->is_write(), cmd->is_prior(),
+      [executor, scmd](const ZPClientChannel::TaskDone& done) {
+        RunScheduled(executor, scmd, done);
+      });
+}
+
+// A paced write comes back after its delay, the commands after it
+// on the connection keep waiting till then
+void ZPDataClientConn::RunScheduled(ZPDataExecutor* executor,
+    const std::shared_ptr<ScheduledCommand>& scmd,
+    const ZPClientChannel::TaskDone& done) {
+  client::CmdResponse response;
+  int ret = ExecuteCommand(scmd->cmd, scmd->request, &response,
+      slash::NowMicros() - scmd->submit_us,
+      Slice(scmd->wire.data(), scmd->wire.size()), &scmd->paced_us);
+  if (ret == 1) {
+    executor->ScheduleAfter(scmd->paced_us, scmd->affinity,
+        [executor, scmd, done]() {
+          RunScheduled(executor, scmd, done);
+        });
+    return;
+  }
+  scmd->chan->Reply(scmd->seq, response);
+  done();
+}
+
+int ZPDataClientConn::ExecuteCommand(const Cmd* cmd,
+    const client::CmdRequest& request, client::CmdResponse* response,
+    uint64_t queue_us, const Slice& wire, uint64_t* paced_us) {
   if (!cmd->is_single_paritition()) {
-    cmd->Do(&request_, &response_);
+    cmd->Do(&request, response);
     return 0;
   }
 
   // Single Partition related Cmds
   std::shared_ptr<Partition> partition;
-  int partition_id = cmd->ExtractPartition(&request_);
+  int partition_id = cmd->ExtractPartition(&request);
   if (partition_id >= 0) {
     partition = zp_data_server->GetTablePartitionById(
-        cmd->ExtractTable(&request_), partition_id);
+        cmd->ExtractTable(&request), partition_id);
   } else {
     partition = zp_data_server->GetTablePartition(
-        cmd->ExtractTable(&request_), cmd->ExtractKey(&request_));
+        cmd->ExtractTable(&request), cmd->ExtractKey(&request));
   }
 
   if (partition == NULL) {
     // Partition not found
-    response_.set_type(request_.type());
-    response_.set_code(client::StatusCode::kError);
-    response_.set_msg("no partition");
+    response->set_type(request.type());
+    response->set_code(client::StatusCode::kError);
+    response->set_msg("no partition");
     return -1;
   }
 
-  partition->DoCommand(cmd, request_, &response_);
+  if (!partition->DoCommand(cmd, request, response, queue_us, wire,
+        paced_us)) {
+    return 1;
+  }
 
   return 0;
 }
@@ -101,6 +302,9 @@ int ZPDataClientConn::DealMessageInternal() {
 void ZPDataClientConnHandle::CronHandle() const {
   // Note: ServerCurrentQPS is the sum of client qps and sync qps;
   zp_data_server->ResetLastStat(StatType::kClient);
+  if (zp_data_server->data_executor() != NULL) {
+    zp_data_server->data_executor()->RollQueueStat();
+  }
 
   Statistic stat;
   zp_data_server->GetTotalStat(StatType::kClient, &stat);
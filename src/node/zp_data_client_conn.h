@@ -15,11 +15,14 @@
 #define SRC_NODE_ZP_DATA_CLIENT_CONN_H_
 
 #include <string>
+#include <memory>
 #include "pink/include/pb_conn.h"
 #include "pink/include/pink_thread.h"
 #include "pink/include/server_thread.h"
 
+#include "include/zp_command.h"
 #include "src/node/client.pb.h"
+#include "src/node/zp_data_executor.h"
 
 class ZPDataClientConn : public pink::PbConn  {
  public:
@@ -27,13 +30,33 @@ class ZPDataClientConn : public pink::PbConn  {
       pink::ServerThread *server_thread);
   virtual ~ZPDataClientConn();
 
+  virtual pink::ReadStatus GetRequest() override;
   virtual int DealMessage();
 
  private:
   client::CmdRequest request_;
   client::CmdResponse response_;
 
-  int DealMessageInternal();
+  int DealFrame(const char* data, int len);
+  int DealMessageInternal(const char* data, int len, bool* scheduled);
+
+  // Pipeline related
+  std::string in_buf_;  // read but not handled yet
+
+  // Executor related
+  std::shared_ptr<ZPClientChannel> channel_;
+  std::shared_ptr<ZPClientChannel> channel();
+  void ScheduleCommand(ZPDataExecutor* executor, const Cmd* cmd,
+      const slash::Slice& wire);
+  struct ScheduledCommand;
+  static void RunScheduled(ZPDataExecutor* executor,
+      const std::shared_ptr<ScheduledCommand>& scmd,
+      const ZPClientChannel::TaskDone& done);
+  // wire is the request bytes as received, empty if request is changed.
+  // Return 1 if the write is paced, see Partition::DoCommand
+  static int ExecuteCommand(const Cmd* cmd, const client::CmdRequest& request,
+      client::CmdResponse* response, uint64_t queue_us = 0,
+      const slash::Slice& wire = slash::Slice(), uint64_t* paced_us = NULL);
 };
 
 class ZPDataClientConnHandle : public pink::ServerHandle  {
@@ -20,6 +20,7 @@
 #include "slash/include/slash_string.h"
 
 #include "include/db_nemo.h"
+#include "include/zp_log.h"
 #include "src/node/zp_data_server.h"
 
 extern ZPDataServer *zp_data_server;
@@ -37,8 +38,10 @@ void SetCmd::Do(const google::protobuf::Message *req,
   response->set_type(client::Type::SET);
 
   rocksdb::Status s;
+  int ttl = 0;
   if (request->set().has_expire()) {
-    int base = 0, ttl = request->set().expire().ttl();
+    int base = 0;
+    ttl = request->set().expire().ttl();
     if (request->set().expire().has_base()) {
       // Come from sync conn
       base = request->set().expire().base();
@@ -65,7 +68,7 @@ void SetCmd::Do(const google::protobuf::Message *req,
   if (!s.ok()) {
     response->set_code(client::StatusCode::kError);
     response->set_msg(s.ToString());
-    LOG(WARNING) << "command failed: Set key(" << request->set().key()
+    LOG_LIMITED(WARNING) << "command failed: Set key(" << request->set().key()
       << ") at " << ptr->table_name() << "_" << ptr->partition_id()
       << ", caz:" << s.ToString();
   } else {
@@ -73,18 +76,49 @@ void SetCmd::Do(const google::protobuf::Message *req,
     DLOG(INFO) << "Set key(" << request->set().key() << ") at "
       << ptr->table_name() << "_" << ptr->partition_id() << " ok";
   }
+
+  // Lookups start later should see this write, notice
+  // row cache should be updated after the in-flight one is forgot.
+  // Forget even coalesce is off now, it may be turned on again
+  // while a lookup started before is still in flight
+  ptr->get_flight()->Forget(request->set().key());
+
+  ZPRowCache* cache = zp_data_server->row_cache();
+  if (cache != NULL) {
+    std::string cache_key = ptr->RowCacheKey(request->set().key());
+    if (s.ok()) {
+      uint64_t expire_us = ttl > 0 ?
+        slash::NowMicros() + static_cast<uint64_t>(ttl) * 1000000 : 0;
+      cache->Update(cache_key, request->set().value(), expire_us);
+    } else {
+      cache->Erase(cache_key);
+    }
+  }
 }
 
 bool SetCmd::GenerateLog(const google::protobuf::Message *req,
     std::string* log_raw) const {
+  std::string patch;
+  if (!req->SerializeToString(log_raw)
+      || !GenerateLogPatch(req, &patch)) {
+    return false;
+  }
+  log_raw->append(patch);
+  return true;
+}
+
+// Expire base is set by a trailing Set, which merges into the one before
+bool SetCmd::GenerateLogPatch(const google::protobuf::Message *req,
+    std::string* patch) const {
   const client::CmdRequest* request =
     static_cast<const client::CmdRequest*>(req);
+  patch->clear();
   if (request->set().has_expire()) {
-    client::CmdRequest log_req(*request);
-    log_req.mutable_set()->mutable_expire()->set_base(time(NULL));
-    return log_req.SerializeToString(log_raw);
+    client::CmdRequest patch_req;
+    patch_req.mutable_set()->mutable_expire()->set_base(time(NULL));
+    return patch_req.SerializePartialToString(patch);
   }
-  return request->SerializeToString(log_raw);
+  return true;
 }
 
 void GetCmd::Do(const google::protobuf::Message *req,
@@ -98,10 +132,43 @@ void GetCmd::Do(const google::protobuf::Message *req,
   client::CmdResponse_Get* get_res = response->mutable_get();
   response->set_type(client::Type::GET);
 
+  // Try row cache first
   std::string value;
-  rocksdb::Status s = ptr->db()->Get(rocksdb::ReadOptions(),
-      request->get().key(),
-      &value);
+  std::string cache_key;
+  RowCacheTicket ticket;
+  ZPRowCache* cache = zp_data_server->row_cache();
+  if (cache != NULL) {
+    cache_key = ptr->RowCacheKey(request->get().key());
+    if (cache->Lookup(cache_key, get_res->mutable_value(), &ticket)) {
+      response->set_code(client::StatusCode::kOk);
+      return;
+    }
+  }
+
+  rocksdb::Status s;
+  if (g_zp_conf->enable_get_coalesce()) {
+    // Share the lookup with concurrent GETs of the same key
+    s = ptr->get_flight()->Do(request->get().key(), &value,
+        [ptr, request](std::string* v) {
+          return ptr->db()->Get(rocksdb::ReadOptions(),
+              request->get().key(), v);
+        });
+  } else {
+    s = ptr->db()->Get(rocksdb::ReadOptions(),
+        request->get().key(),
+        &value);
+  }
+  if (s.ok() && cache != NULL && ticket.admit) {
+    // Keys with ttl should leave cache before they expire in db
+    int32_t ttl = 0;
+    rocksdb::Status ts = ptr->db()->GetKeyTTL(rocksdb::ReadOptions(),
+        request->get().key(), &ttl);
+    if (ts.ok() && (ttl == -1 || ttl > 1)) {
+      uint64_t expire_us = ttl > 1 ?
+        slash::NowMicros() + static_cast<uint64_t>(ttl - 1) * 1000000 : 0;
+      cache->Insert(cache_key, value, expire_us, ticket);
+    }
+  }
   if (s.ok()) {
     response->set_code(client::StatusCode::kOk);
     get_res->set_value(value);
@@ -116,7 +183,7 @@ void GetCmd::Do(const google::protobuf::Message *req,
   } else {
     response->set_code(client::StatusCode::kError);
     response->set_msg(s.ToString());
-    LOG(WARNING) << "command failed: Get key("
+    LOG_LIMITED(WARNING) << "command failed: Get key("
       << request->get().key() << ") at "
       << ptr->table_name() << "_"
       << ptr->partition_id()
@@ -136,10 +203,15 @@ void DelCmd::Do(const google::protobuf::Message *req,
 
   rocksdb::Status s = ptr->db()->Delete(rocksdb::WriteOptions(),
       request->del().key());
+  ptr->get_flight()->Forget(request->del().key());
+  ZPRowCache* cache = zp_data_server->row_cache();
+  if (cache != NULL) {
+    cache->Erase(ptr->RowCacheKey(request->del().key()));
+  }
   if (!s.ok()) {
     response->set_code(client::StatusCode::kError);
     response->set_msg(s.ToString());
-    LOG(WARNING) << "command failed: Del key(" << request->del().key()
+    LOG_LIMITED(WARNING) << "command failed: Del key(" << request->del().key()
       << ") at " << ptr->table_name() << "_" << ptr->partition_id()
       << ", caz:" << s.ToString();
   } else {
@@ -167,7 +239,7 @@ void MgetCmd::Do(const google::protobuf::Message *req,
     std::shared_ptr<Partition> partition = zp_data_server->GetTablePartition(
         request->mget().table_name(), key);
     if (partition == NULL) {
-      LOG(WARNING) << "command failed: Mget, no partition for key:" << key;
+      LOG_LIMITED(WARNING) << "command failed: Mget, no partition for key:" << key;
       response->set_code(client::StatusCode::kError);
       response->set_msg("no partition" + key);
       return;
@@ -179,6 +251,12 @@ void MgetCmd::Do(const google::protobuf::Message *req,
     client::CmdRequest_Get* get = sub_req.mutable_get();
     get->set_table_name(request->mget().table_name());
     get->set_key(key);
+    if (request->has_deadline_us()) {
+      sub_req.set_deadline_us(request->deadline_us());
+    }
+    if (request->mget().has_max_lag_ms()) {
+      get->set_max_lag_ms(request->mget().max_lag_ms());
+    }
     partition->DoCommand(sub_cmd, sub_req, &sub_res);
     if (sub_res.code() != client::StatusCode::kOk
         && sub_res.code() != client::StatusCode::kNotFound) {
@@ -235,6 +313,19 @@ void InfoCmd::Do(const google::protobuf::Message *req,
         info_stat->set_total_querys(it->querys);
         info_stat->set_qps(it->last_qps);
         info_stat->set_latency_info(FormatLatency(*it));
+        info_stat->set_expired(it->expired);
+      }
+
+      ZPRowCache* cache = zp_data_server->row_cache();
+      if (cache != NULL) {
+        ZPRowCache::Stat cstat;
+        cache->GetStat(&cstat);
+        client::CmdResponse_RowCache* row_cache =
+          response->mutable_row_cache();
+        row_cache->set_capacity(cstat.capacity);
+        row_cache->set_usage(cstat.usage);
+        row_cache->set_hits(cstat.hits);
+        row_cache->set_misses(cstat.misses);
       }
       break;
     }
@@ -277,6 +368,32 @@ void InfoCmd::Do(const google::protobuf::Message *req,
       response->mutable_info_server()->CopyFrom(info_server);
       break;
     }
+    case client::Type::INFOSLOWLOG: {
+      response->set_type(client::Type::INFOSLOWLOG);
+      int num = kSlowlogMaxLen;
+      if (request->has_info() && request->info().has_slowlog_num()) {
+        num = request->info().slowlog_num();
+      }
+      std::vector<SlowlogEntry> entries;
+      zp_data_server->slowlog()->Get(num < 0 ? 0 : num, table_name,
+          &entries);
+
+      for (auto& entry : entries) {
+        client::CmdResponse_Slowlog* slowlog = response->add_slowlog();
+        slowlog->set_id(entry.id);
+        slowlog->set_time(entry.time);
+        slowlog->set_cmd(entry.cmd);
+        slowlog->set_table_name(entry.table_name);
+        slowlog->set_partition_id(entry.partition_id);
+        slowlog->set_key(entry.key);
+        slowlog->set_from_sync(entry.from_sync);
+        slowlog->set_duration_us(entry.duration_us);
+        slowlog->set_queue_us(entry.queue_us);
+        slowlog->set_lock_us(entry.lock_us);
+        slowlog->set_perf(entry.perf);
+      }
+      break;
+    }
     default: {
       response->set_code(client::StatusCode::kError);
       response->set_msg("unsupported cmd type");
@@ -399,3 +516,108 @@ void FlushDBCmd::Do(const google::protobuf::Message *req,
       << ptr->table_name() << "_" << ptr->partition_id();
   }
 }
+
+// Without executor, it runs on the dispatch thread, where no wait is
+// allowed, so only the ones with no timeout are served
+void WaitCmd::Do(const google::protobuf::Message *req,
+    google::protobuf::Message *res, void* p) const {
+  const client::CmdRequest* request =
+    static_cast<const client::CmdRequest*>(req);
+  client::CmdResponse* response = static_cast<client::CmdResponse*>(res);
+  response->Clear();
+  response->set_type(client::Type::WAIT);
+  if (request->wait().timeout_ms() > 0) {
+    response->set_code(client::StatusCode::kError);
+    response->set_msg("WAIT with timeout needs data_exec_thread_num > 0");
+    return;
+  }
+  // Replied right now without timeout
+  DoAsync(*request, [response](const client::CmdResponse& result) {
+    response->CopyFrom(result);
+  });
+}
+
+// Reply once enough slaves have applied the binlog offset, or timeout.
+// The request is parked in partition, no thread is blocked meanwhile
+void WaitCmd::DoAsync(const client::CmdRequest& request,
+    const std::function<void(const client::CmdResponse&)>& reply) const {
+  client::CmdResponse response;
+  response.set_type(client::Type::WAIT);
+
+  const client::CmdRequest_Wait& wait = request.wait();
+  std::shared_ptr<Partition> partition = zp_data_server->GetTablePartitionById(
+      wait.table_name(), wait.offset().partition());
+  if (partition == NULL) {
+    response.set_code(client::StatusCode::kError);
+    response.set_msg("no partition");
+    reply(response);
+    return;
+  }
+
+  int timeout_ms = wait.has_timeout_ms() ? wait.timeout_ms() : 0;
+  if (timeout_ms < 0) {
+    timeout_ms = 0;
+  } else if (timeout_ms > kWaitMaxTimeout) {
+    timeout_ms = kWaitMaxTimeout;
+  }
+
+  BinlogOffset target(wait.offset().filenum(), wait.offset().offset());
+  std::string table_name = partition->table_name();
+  int partition_id = partition->partition_id();
+  Node master = partition->master_node();
+  partition->WaitSlaveAck(target, wait.num_slaves(), timeout_ms,
+      [reply, response, target, table_name, partition_id, master](
+        bool is_master, int acked) mutable {
+        if (!is_master) {
+          response.set_code(client::StatusCode::kMove);
+          response.set_msg("Command Redirect");
+          client::Node* node = response.mutable_redirect();
+          node->set_ip(master.ip);
+          node->set_port(master.port);
+          reply(response);
+          return;
+        }
+        response.set_code(client::StatusCode::kOk);
+        response.mutable_wait()->set_acked(acked);
+        DLOG(INFO) << "Wait at " << table_name << "_" << partition_id
+          << " for (" << target.filenum << ", " << target.offset << "), "
+          << acked << " slaves acked";
+        reply(response);
+      });
+}
+
+// Items are changed in memory only, the conf file is not rewritten
+void ConfigCmd::Do(const google::protobuf::Message *req,
+    google::protobuf::Message *res, void* p) const {
+  const client::CmdRequest* request =
+    static_cast<const client::CmdRequest*>(req);
+  client::CmdResponse* response = static_cast<client::CmdResponse*>(res);
+  response->Clear();
+  response->set_type(client::Type::CONFIG);
+
+  const client::CmdRequest_Config& config = request->config();
+  std::string action = slash::StringToLower(config.action());
+  if (action == "set") {
+    std::string msg;
+    if (!g_zp_conf->Set(config.name(), config.value(), &msg)) {
+      response->set_code(client::StatusCode::kError);
+      response->set_msg(msg);
+      return;
+    }
+    LOG(INFO) << "Config set " << config.name() << " to " << config.value();
+  } else if (action != "get") {
+    response->set_code(client::StatusCode::kError);
+    response->set_msg("unknown config action");
+    return;
+  }
+
+  std::vector<std::pair<std::string, std::string>> items;
+  g_zp_conf->Get(config.name(), &items);
+  for (auto& item : items) {
+    client::CmdResponse_Config_Item* res_item =
+      response->mutable_config()->add_items();
+    res_item->set_name(item.first);
+    res_item->set_value(item.second);
+  }
+  response->set_code(client::StatusCode::kOk);
+}
@@ -15,6 +15,7 @@
 #define SRC_NODE_ZP_DATA_COMMAND_H_
 
 #include <string>
+#include <functional>
 #include "include/zp_command.h"
 
 ////// kv ///// /
@@ -28,6 +29,8 @@ class SetCmd : public Cmd  {
       google::protobuf::Message *res, void* partition) const;
   virtual bool GenerateLog(const google::protobuf::Message *request,
       std::string* raw) const;
+  virtual bool GenerateLogPatch(const google::protobuf::Message *request,
+      std::string* patch) const;
   virtual std::string ExtractTable(const google::protobuf::Message *req) const {
     const client::CmdRequest* request =
       static_cast<const client::CmdRequest*>(req);
@@ -155,4 +158,37 @@ class FlushDBCmd : public Cmd  {
   }
 };
 
+class WaitCmd : public Cmd  {
+ public:
+  explicit WaitCmd(int flag) : Cmd(flag, kWaitCmd) {}
+  virtual std::string name() const {
+    return "Wait";
+  }
+  virtual void Do(const google::protobuf::Message *req,
+      google::protobuf::Message *res, void* partition = NULL) const;
+  // reply is called exactly once, maybe by another thread later
+  void DoAsync(const client::CmdRequest& request,
+      const std::function<void(const client::CmdResponse&)>& reply) const;
+  virtual std::string ExtractTable(const google::protobuf::Message *req) const {
+    const client::CmdRequest* request =
+      static_cast<const client::CmdRequest*>(req);
+    return request->wait().table_name();
+  }
+  virtual int ExtractPartition(const google::protobuf::Message *req) const {
+    const client::CmdRequest* request =
+      static_cast<const client::CmdRequest*>(req);
+    return request->wait().offset().partition();
+  }
+};
+
+class ConfigCmd : public Cmd  {
+ public:
+  explicit ConfigCmd(int flag) : Cmd(flag, kConfigCmd) {}
+  virtual std::string name() const {
+    return "Config";
+  }
+  virtual void Do(const google::protobuf::Message *req,
+      google::protobuf::Message *res, void* partition = NULL) const;
+};
+
 #endif  // SRC_NODE_ZP_DATA_COMMAND_H_
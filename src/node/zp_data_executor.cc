@@ -0,0 +1,515 @@
+// Copyright 2017 Qihoo
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http:// www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include "src/node/zp_data_executor.h"
+
+#include <errno.h>
+#include <limits.h>
+#include <algorithm>
+#include <unistd.h>
+#include <sys/uio.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+#include <glog/logging.h>
+
+#include "slash/include/env.h"
+
+#include "include/zp_const.h"
+#include "include/zp_log.h"
+
+static const int kReplyFlushEvents = 64;
+
+////// ZPReplyFlusher ///// /
+ZPReplyFlusher::ZPReplyFlusher()
+  : pink::Thread::Thread(),
+  epfd_(epoll_create1(EPOLL_CLOEXEC)),
+  stopped_(false) {
+    set_thread_name("ZPReplyFlusher");
+  }
+
+ZPReplyFlusher::~ZPReplyFlusher() {
+  Stop();
+  if (epfd_ >= 0) {
+    close(epfd_);
+  }
+}
+
+Status ZPReplyFlusher::Start() {
+  if (epfd_ < 0) {
+    return Status::Corruption("Reply flusher epoll create failed");
+  }
+  if (pink::RetCode::kSuccess != StartThread()) {
+    return Status::Corruption("Reply flusher thread start failed");
+  }
+  return Status::OK();
+}
+
+void ZPReplyFlusher::Stop() {
+  StopThread();
+  std::map<int, std::shared_ptr<ZPClientChannel>> channels;
+  {
+    slash::MutexLock l(&mu_);
+    stopped_ = true;
+    channels.swap(channels_);
+  }
+}
+
+bool ZPReplyFlusher::Watch(const std::shared_ptr<ZPClientChannel>& chan,
+    int fd, bool rearm) {
+  slash::MutexLock l(&mu_);
+  if (stopped_) {
+    return false;
+  }
+  struct epoll_event ev;
+  ev.events = EPOLLOUT | EPOLLONESHOT;
+  ev.data.fd = fd;
+  if (epoll_ctl(epfd_, rearm ? EPOLL_CTL_MOD : EPOLL_CTL_ADD, fd, &ev) != 0) {
+    return false;
+  }
+  channels_[fd] = chan;
+  return true;
+}
+
+void ZPReplyFlusher::Unwatch(int fd) {
+  slash::MutexLock l(&mu_);
+  epoll_ctl(epfd_, EPOLL_CTL_DEL, fd, NULL);
+  channels_.erase(fd);
+}
+
+void* ZPReplyFlusher::ThreadMain() {
+  struct epoll_event events[kReplyFlushEvents];
+  while (!should_stop()) {
+    // Wake up in time to check should_stop
+    int n = epoll_wait(epfd_, events, kReplyFlushEvents, kExecIdleWait);
+    for (int i = 0; i < n; i++) {
+      std::shared_ptr<ZPClientChannel> chan;
+      {
+        slash::MutexLock l(&mu_);
+        auto it = channels_.find(events[i].data.fd);
+        if (it != channels_.end()) {
+          chan = it->second;
+        }
+      }
+      if (chan) {
+        chan->Flush();
+      }
+    }
+  }
+  return NULL;
+}
+
+////// ZPClientChannel ///// /
+ZPClientChannel::ZPClientChannel(int fd,
+    const std::shared_ptr<ZPReplyFlusher>& flusher)
+  : fd_(dup(fd)),
+  next_seq_(0),
+  flusher_(flusher),
+  broken_(false),
+  send_seq_(0),
+  out_pos_(0),
+  out_bytes_(0),
+  watched_(false),
+  running_(0),
+  running_write_(false) {
+    if (fd_ < 0) {
+      LOG(WARNING) << "ZPClientChannel dup fd " << fd
+        << " failed, errno: " << errno;
+      broken_ = true;
+    }
+  }
+
+ZPClientChannel::~ZPClientChannel() {
+  if (fd_ >= 0) {
+    close(fd_);
+  }
+}
+
+void ZPClientChannel::Reply(uint64_t seq,
+    const client::CmdResponse& response) {
+  // [ length (int32) | pb_msg (length bytes) ]
+  std::string frame;
+  uint32_t len = htonl(response.ByteSize());
+  frame.append(reinterpret_cast<const char*>(&len), sizeof(len));
+  response.AppendToString(&frame);
+
+  slash::MutexLock l(&mu_);
+  pending_[seq].swap(frame);
+  auto it = pending_.begin();
+  while (it != pending_.end() && it->first == send_seq_) {
+    out_bytes_ += it->second.size();
+    out_.push_back(std::string());
+    out_.back().swap(it->second);
+    it = pending_.erase(it);
+    send_seq_++;
+  }
+  if (broken_) {
+    out_.clear();
+    return;
+  }
+  if (!watched_) {
+    // Otherwise flusher writes them in order when fd is writable
+    WriteOut();
+  }
+}
+
+void ZPClientChannel::Flush() {
+  slash::MutexLock l(&mu_);
+  if (!broken_) {
+    WriteOut();
+  }
+}
+
+// Required: hold mu_
+// Write as much as the socket takes, the fd is nonblocking as the
+// connection's, the rest is left to flusher
+void ZPClientChannel::WriteOut() {
+  while (!out_.empty()) {
+    struct iovec iov[IOV_MAX];
+    int iov_num = 0;
+    for (size_t i = 0; i < out_.size() && iov_num < IOV_MAX; i++) {
+      size_t skip = (i == 0) ? out_pos_ : 0;
+      iov[iov_num].iov_base = const_cast<char*>(out_[i].data()) + skip;
+      iov[iov_num].iov_len = out_[i].size() - skip;
+      iov_num++;
+    }
+
+    ssize_t n = writev(fd_, iov, iov_num);
+    if (n > 0) {
+      out_bytes_ -= n;
+      size_t left = n;
+      while (left > 0) {
+        size_t remain = out_.front().size() - out_pos_;
+        if (left < remain) {
+          out_pos_ += left;
+          break;
+        }
+        left -= remain;
+        out_.pop_front();
+        out_pos_ = 0;
+      }
+      continue;
+    }
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+      if (out_bytes_ > kExecReplyMaxPending) {
+        LOG_LIMITED(WARNING) << "ZPClientChannel too many unsent replies, fd: "
+          << fd_ << ", bytes: " << out_bytes_;
+        Broken();
+        return;
+      }
+      if (!flusher_->Watch(shared_from_this(), fd_, watched_)) {
+        LOG_LIMITED(WARNING) << "ZPClientChannel watch failed, fd: " << fd_
+          << ", errno: " << errno;
+        Broken();
+        return;
+      }
+      watched_ = true;
+      return;
+    }
+    LOG_LIMITED(WARNING) << "ZPClientChannel write failed, fd: " << fd_
+      << ", errno: " << errno;
+    Broken();
+    return;
+  }
+  if (watched_) {
+    flusher_->Unwatch(fd_);
+    watched_ = false;
+  }
+}
+
+// Required: hold mu_
+// Replies left are dropped, and the client sees the connection closed
+void ZPClientChannel::Broken() {
+  broken_ = true;
+  out_.clear();
+  out_pos_ = 0;
+  out_bytes_ = 0;
+  if (watched_) {
+    flusher_->Unwatch(fd_);
+    watched_ = false;
+  }
+  shutdown(fd_, SHUT_RDWR);
+}
+
+void ZPClientChannel::Submit(ZPDataExecutor* executor, uint64_t affinity,
+    bool is_write, bool prior, const Task& task) {
+  {
+    slash::MutexLock l(&gate_mu_);
+    if (!waiting_.empty()
+        || running_write_
+        || (is_write && running_ > 0)) {
+      waiting_.push_back(WaitingTask(affinity, is_write, prior, task));
+      return;
+    }
+    running_++;
+    running_write_ = is_write;
+  }
+  Start(executor, affinity, prior, task);
+}
+
+void ZPClientChannel::Start(ZPDataExecutor* executor, uint64_t affinity,
+    bool prior, const Task& task) {
+  std::shared_ptr<ZPClientChannel> self = shared_from_this();
+  executor->Schedule(affinity, [self, executor, task]() {
+    task([self, executor]() {
+      self->Done(executor);
+    });
+  }, prior);
+}
+
+void ZPClientChannel::Done(ZPDataExecutor* executor) {
+  std::vector<WaitingTask> ready;
+  {
+    slash::MutexLock l(&gate_mu_);
+    running_--;
+    if (running_ == 0) {
+      running_write_ = false;
+    }
+    while (!waiting_.empty()) {
+      const WaitingTask& next = waiting_.front();
+      if (running_write_
+          || (next.is_write && running_ > 0)) {
+        break;
+      }
+      running_++;
+      running_write_ = next.is_write;
+      ready.push_back(next);
+      waiting_.pop_front();
+    }
+  }
+  for (auto& t : ready) {
+    Start(executor, t.affinity, t.prior, t.task);
+  }
+}
+
+////// ZPDataExecutor ///// /
+ZPDataExecutor::ExecThread::ExecThread(ZPDataExecutor* executor, int index)
+  : pink::Thread::Thread(),
+  executor_(executor),
+  index_(index) {
+    set_thread_name("ZPDataExecutor");
+  }
+
+ZPDataExecutor::ExecThread::~ExecThread() {
+  StopThread();
+}
+
+void* ZPDataExecutor::ExecThread::ThreadMain() {
+  Task task;
+  while (!should_stop()) {
+    if (!executor_->Fetch(index_, &task)) {
+      executor_->WaitTask();
+      continue;
+    }
+    task();
+    task = nullptr;
+  }
+  return NULL;
+}
+
+ZPDataExecutor::ZPDataExecutor(int thread_num)
+  : pending_(0),
+  flusher_(std::make_shared<ZPReplyFlusher>()),
+  next_delayed_us_(0),
+  idle_cv_(&idle_mu_) {
+    for (int i = 0; i < 2; i++) {
+      class_pending_[i] = 0;
+      class_tasks_[i] = 0;
+      class_delay_us_[i] = 0;
+      class_max_delay_us_[i] = 0;
+      last_stat_[i] = QueueStat();
+    }
+    for (int i = 0; i < thread_num; i++) {
+      queues_.push_back(new WorkQueue());
+      threads_.push_back(new ExecThread(this, i));
+    }
+  }
+
+ZPDataExecutor::~ZPDataExecutor() {
+  for (auto thread : threads_) {
+    delete thread;
+  }
+  // Channels may live longer, which could not use it any more
+  flusher_->Stop();
+  // Tasks left are dropped
+  for (auto queue : queues_) {
+    delete queue;
+  }
+  LOG(INFO) << "ZPDataExecutor exit!";
+}
+
+Status ZPDataExecutor::Start() {
+  Status s = flusher_->Start();
+  if (!s.ok()) {
+    return s;
+  }
+  for (auto thread : threads_) {
+    if (pink::RetCode::kSuccess != thread->StartThread()) {
+      return Status::Corruption("Data executor thread start failed!");
+    }
+  }
+  return Status::OK();
+}
+
+void ZPDataExecutor::Schedule(uint64_t affinity, const Task& task,
+    bool prior) {
+  WorkQueue* queue = queues_[affinity % queues_.size()];
+  int cls = prior ? kExecPrior : kExecNormal;
+  // Count first, so that pending_ never goes below the real number
+  pending_++;
+  class_pending_[cls]++;
+  QueuedTask qtask;
+  qtask.task = task;
+  qtask.enqueue_us = slash::NowMicros();
+  {
+    slash::MutexLock l(&queue->mu);
+    queue->tasks[cls].push_back(qtask);
+  }
+
+  slash::MutexLock l(&idle_mu_);
+  idle_cv_.Signal();
+}
+
+void ZPDataExecutor::ScheduleAfter(uint64_t delay_us, uint64_t affinity,
+    const Task& task) {
+  uint64_t when = slash::NowMicros() + delay_us;
+  DelayedTask dtask;
+  dtask.affinity = affinity;
+  dtask.task = task;
+  {
+    slash::MutexLock l(&delayed_mu_);
+    delayed_.insert(std::make_pair(when, dtask));
+    next_delayed_us_ = delayed_.begin()->first;
+  }
+
+  // Idle threads should wake up in time for it
+  slash::MutexLock l(&idle_mu_);
+  idle_cv_.Signal();
+}
+
+// Move delayed tasks whose time has come to the work queues
+void ZPDataExecutor::QueueDelayed(uint64_t now) {
+  uint64_t next = next_delayed_us_;
+  if (next == 0 || next > now) {
+    return;
+  }
+  std::vector<DelayedTask> due;
+  {
+    slash::MutexLock l(&delayed_mu_);
+    auto it = delayed_.begin();
+    while (it != delayed_.end() && it->first <= now) {
+      due.push_back(it->second);
+      it = delayed_.erase(it);
+    }
+    next_delayed_us_ = delayed_.empty() ? 0 : delayed_.begin()->first;
+  }
+  for (auto& dtask : due) {
+    Schedule(dtask.affinity, dtask.task);
+  }
+}
+
+// Required: hold mu of queue
+// Return -1 if queue is empty
+int ZPDataExecutor::PickClass(WorkQueue* queue, uint64_t now) {
+  std::deque<QueuedTask>& prior = queue->tasks[kExecPrior];
+  std::deque<QueuedTask>& normal = queue->tasks[kExecNormal];
+  if (normal.empty()) {
+    return prior.empty() ? -1 : kExecPrior;
+  }
+  if (prior.empty()
+      || now - normal.front().enqueue_us
+          > static_cast<uint64_t>(kExecStarveTime) * 1000) {
+    // Avoid starvation of normal ones
+    return kExecNormal;
+  }
+  return kExecPrior;
+}
+
+// Take from the head of its own queue, or steal from the tail of others
+bool ZPDataExecutor::Fetch(int index, Task* task) {
+  uint64_t now = slash::NowMicros();
+  QueueDelayed(now);
+  if (pending_ == 0) {
+    return false;
+  }
+  size_t num = queues_.size();
+  for (size_t i = 0; i < num; i++) {
+    WorkQueue* queue = queues_[(index + i) % num];
+    slash::MutexLock l(&queue->mu);
+    int cls = PickClass(queue, now);
+    if (cls < 0) {
+      continue;
+    }
+    QueuedTask qtask;
+    if (i == 0) {
+      qtask = queue->tasks[cls].front();
+      queue->tasks[cls].pop_front();
+    } else {
+      qtask = queue->tasks[cls].back();
+      queue->tasks[cls].pop_back();
+    }
+    pending_--;
+    class_pending_[cls]--;
+    *task = qtask.task;
+    RecordDelay(cls, now > qtask.enqueue_us ? now - qtask.enqueue_us : 0);
+    return true;
+  }
+  return false;
+}
+
+void ZPDataExecutor::RecordDelay(int cls, uint64_t delay_us) {
+  class_tasks_[cls]++;
+  class_delay_us_[cls] += delay_us;
+  uint64_t max = class_max_delay_us_[cls];
+  while (delay_us > max
+      && !class_max_delay_us_[cls].compare_exchange_weak(max, delay_us)) {
+  }
+}
+
+// Called every stat interval
+void ZPDataExecutor::RollQueueStat() {
+  slash::MutexLock l(&stat_mu_);
+  for (int i = 0; i < 2; i++) {
+    uint64_t tasks = class_tasks_[i].exchange(0);
+    uint64_t delay = class_delay_us_[i].exchange(0);
+    last_stat_[i].tasks = tasks;
+    last_stat_[i].avg_delay_us = tasks == 0 ? 0 : delay / tasks;
+    last_stat_[i].max_delay_us = class_max_delay_us_[i].exchange(0);
+  }
+}
+
+void ZPDataExecutor::GetQueueStat(ExecClass cls, QueueStat* stat) {
+  slash::MutexLock l(&stat_mu_);
+  *stat = last_stat_[cls];
+  stat->pending = class_pending_[cls];
+}
+
+void ZPDataExecutor::WaitTask() {
+  // Wake up in time to check should_stop, and for the next delayed one
+  uint64_t wait_ms = kExecIdleWait;
+  uint64_t next = next_delayed_us_;
+  if (next > 0) {
+    uint64_t now = slash::NowMicros();
+    wait_ms = std::min(wait_ms, next > now ? (next - now) / 1000 + 1 : 0);
+  }
+  if (wait_ms == 0) {
+    return;
+  }
+  slash::MutexLock l(&idle_mu_);
+  if (pending_ == 0) {
+    idle_cv_.TimedWait(wait_ms);
+  }
+}
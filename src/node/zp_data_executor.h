@@ -0,0 +1,235 @@
+// Copyright 2017 Qihoo
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http:// www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#ifndef SRC_NODE_ZP_DATA_EXECUTOR_H_
+#define SRC_NODE_ZP_DATA_EXECUTOR_H_
+
+#include <map>
+#include <deque>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+#include <functional>
+
+#include "pink/include/pink_thread.h"
+#include "slash/include/slash_mutex.h"
+#include "slash/include/slash_status.h"
+
+#include "src/node/client.pb.h"
+
+using slash::Status;
+
+class ZPDataExecutor;
+class ZPClientChannel;
+
+// Writes replies left by ZPClientChannel once the socket is writable
+// again, so that no executor thread waits for a slow client
+class ZPReplyFlusher : public pink::Thread {
+ public:
+  ZPReplyFlusher();
+  virtual ~ZPReplyFlusher();
+
+  Status Start();
+  // Channels watched are dropped, and no more is accepted
+  void Stop();
+
+  // Flush chan when fd is writable, rearm if it's being watched.
+  // Required: hold mu_ of chan
+  bool Watch(const std::shared_ptr<ZPClientChannel>& chan, int fd,
+      bool rearm);
+  // Required: hold mu_ of chan, and a reference of it
+  void Unwatch(int fd);
+
+ private:
+  int epfd_;
+  slash::Mutex mu_;
+  bool stopped_;
+  std::map<int, std::shared_ptr<ZPClientChannel>> channels_;
+  virtual void* ThreadMain();
+
+  ZPReplyFlusher(const ZPReplyFlusher&);
+  void operator=(const ZPReplyFlusher&);
+};
+
+// Reply path of a client connection whose commands are executed by
+// ZPDataExecutor. It is shared by the connection and the commands in
+// flight, and holds a dup of the connection fd, so that replying is
+// still safe after the connection is closed by pink.
+// Responses are framed as PbConn does, and written in request order,
+// the ones ready together are written by one writev. What the socket
+// doesn't take is left to ZPReplyFlusher, never waited for.
+class ZPClientChannel : public std::enable_shared_from_this<ZPClientChannel> {
+ public:
+  ZPClientChannel(int fd, const std::shared_ptr<ZPReplyFlusher>& flusher);
+  ~ZPClientChannel();
+
+  // Only called by the io thread of the connection
+  uint64_t NextSequence() {
+    return next_seq_++;
+  }
+
+  // Commands of one connection run in parallel, except that a write
+  // waits for all the ones before it, and blocks all the ones after it.
+  // task should call done once it's over, which may be later, from
+  // another task
+  typedef std::function<void()> TaskDone;
+  typedef std::function<void(const TaskDone& done)> Task;
+  void Submit(ZPDataExecutor* executor, uint64_t affinity, bool is_write,
+      bool prior, const Task& task);
+
+  // Should be called exactly once for every sequence
+  void Reply(uint64_t seq, const client::CmdResponse& response);
+  // Called by flusher when the fd is writable
+  void Flush();
+
+ private:
+  int fd_;
+  uint64_t next_seq_;
+  std::shared_ptr<ZPReplyFlusher> flusher_;
+
+  slash::Mutex mu_;
+  bool broken_;
+  uint64_t send_seq_;  // next sequence to be written
+  std::map<uint64_t, std::string> pending_;  // done but not written yet
+  std::deque<std::string> out_;  // in order, but not written yet
+  size_t out_pos_;  // written bytes of the first one
+  size_t out_bytes_;
+  bool watched_;  // out_ is left to flusher
+  void WriteOut();
+  void Broken();
+
+  // Submit related
+  struct WaitingTask {
+    uint64_t affinity;
+    bool is_write;
+    bool prior;
+    Task task;
+    WaitingTask(uint64_t a, bool w, bool p, const Task& t)
+      : affinity(a), is_write(w), prior(p), task(t) {}
+  };
+  slash::Mutex gate_mu_;
+  int running_;
+  bool running_write_;
+  std::deque<WaitingTask> waiting_;
+  void Start(ZPDataExecutor* executor, uint64_t affinity, bool prior,
+      const Task& task);
+  void Done(ZPDataExecutor* executor);
+
+  ZPClientChannel(const ZPClientChannel&);
+  void operator=(const ZPClientChannel&);
+};
+
+enum ExecClass {
+  kExecPrior = 0,
+  kExecNormal = 1,
+};
+const std::string ExecClassMsg[] = {
+  "prior",
+  "normal"
+};
+
+// Threads to execute client commands, so that the dispatch threads only
+// deal with network io. Every thread owns a queue, and tasks with the same
+// affinity go to the same queue to keep the partition data hot in cache.
+// An idle thread steals tasks from the tail of others.
+// Prior tasks go first, unless some normal one has waited for more
+// than kExecStarveTime.
+class ZPDataExecutor {
+ public:
+  typedef std::function<void()> Task;
+
+  explicit ZPDataExecutor(int thread_num);
+  ~ZPDataExecutor();
+
+  Status Start();
+  void Schedule(uint64_t affinity, const Task& task, bool prior = false);
+  // Queued as a normal task no earlier than delay_us later
+  void ScheduleAfter(uint64_t delay_us, uint64_t affinity, const Task& task);
+
+  uint64_t pending() const {
+    return pending_;
+  }
+
+  // Queueing delay of every class, in the last stat interval
+  struct QueueStat {
+    uint64_t pending;
+    uint64_t tasks;
+    uint64_t avg_delay_us;
+    uint64_t max_delay_us;
+  };
+  void GetQueueStat(ExecClass cls, QueueStat* stat);
+  void RollQueueStat();
+
+  std::shared_ptr<ZPReplyFlusher> reply_flusher() const {
+    return flusher_;
+  }
+
+ private:
+  struct QueuedTask {
+    Task task;
+    uint64_t enqueue_us;
+  };
+  struct WorkQueue {
+    slash::Mutex mu;
+    std::deque<QueuedTask> tasks[2];  // index by ExecClass
+  };
+
+  class ExecThread : public pink::Thread {
+   public:
+    ExecThread(ZPDataExecutor* executor, int index);
+    virtual ~ExecThread();
+
+   private:
+    ZPDataExecutor* executor_;
+    int index_;
+    virtual void* ThreadMain();
+  };
+
+  std::vector<WorkQueue*> queues_;
+  std::vector<ExecThread*> threads_;
+  std::atomic<uint64_t> pending_;
+  std::shared_ptr<ZPReplyFlusher> flusher_;
+
+  // Stat related
+  std::atomic<uint64_t> class_pending_[2];
+  std::atomic<uint64_t> class_tasks_[2];
+  std::atomic<uint64_t> class_delay_us_[2];
+  std::atomic<uint64_t> class_max_delay_us_[2];
+  slash::Mutex stat_mu_;
+  QueueStat last_stat_[2];
+  int PickClass(WorkQueue* queue, uint64_t now);
+  void RecordDelay(int cls, uint64_t delay_us);
+
+  // Delayed related
+  struct DelayedTask {
+    uint64_t affinity;
+    Task task;
+  };
+  slash::Mutex delayed_mu_;
+  std::multimap<uint64_t, DelayedTask> delayed_;  // by when to be queued
+  std::atomic<uint64_t> next_delayed_us_;  // 0 if none
+  void QueueDelayed(uint64_t now);
+
+  // Idle threads wait here
+  slash::Mutex idle_mu_;
+  slash::CondVar idle_cv_;
+
+  bool Fetch(int index, Task* task);
+  void WaitTask();
+
+  ZPDataExecutor(const ZPDataExecutor&);
+  void operator=(const ZPDataExecutor&);
+};
+
+#endif  // SRC_NODE_ZP_DATA_EXECUTOR_H_
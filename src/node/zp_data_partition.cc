@@ -20,10 +20,14 @@
 #include <glog/logging.h>
 
 #include <fstream>
+#include <algorithm>
 #include <utility>
 
 #include "slash/include/rsync.h"
+#include "include/zp_log.h"
 #include "src/node/zp_data_server.h"
+#include "src/node/zp_binlog_record.h"
+#include "src/node/zp_trace.h"
 
 extern ZPDataServer* zp_data_server;
 
@@ -43,18 +47,30 @@ struct PurgeArg {
 
 Partition::Partition(const std::string& table_name, const int partition_id,
     const std::string& log_path, const std::string& data_path,
-    const std::string& trash_path)
+    const std::string& trash_path,
+    const std::shared_ptr<ZPTableQuota>& quota)
   : table_name_(table_name),
   partition_id_(partition_id),
   opened_(false),
   pstate_(ZPMeta::PState::ACTIVE),
   role_(Role::kNodeSingle),
   repl_state_(ReplState::kNoConnect),
+  cache_space_(0),
+  quota_(quota),
+  stall_level_(kStallNone),
+  stall_check_time_(0),
+  stall_writers_(0),
   do_recovery_sync_(false),
   recover_sync_flag_(0),
   last_sync_time_(slash::NowMicros()),
   sync_lease_(kBinlogDefaultLease),
   stuck_recover_sync_flag_(0),
+  last_caught_up_time_(0),
+  catchup_rate_(0),
+  slave_lag_(0),
+  last_rate_time_(0),
+  pace_next_us_(0),
+  ack_pending_(false),
   purging_(false),
   purged_index_(0) {
     // Partition related path
@@ -100,6 +116,7 @@ Status Partition::Open() {
       << ", partition_id: " << partition_id_ << ", error: " << rs.ToString();
     return Status::Corruption(rs.ToString());
   }
+  cache_space_ = ZPRowCache::NewSpace();
 
   // Binlog
   Status s = Binlog::Create(log_path_, kBinlogSize, &logger_);
@@ -153,6 +170,8 @@ Partition::~Partition() {
   slash::RWLock l(&state_rw_, true);
   Close();
   }
+  // Every parked WAIT is answered
+  ExpireAckWaiters(true);
   pthread_rwlock_destroy(&fallback_rw_);
   pthread_rwlock_destroy(&purged_index_rw_);
   pthread_rwlock_destroy(&suspend_rw_);
@@ -231,6 +250,8 @@ Status Partition::ChangeDb(const std::string& new_path) {
       << ", error: " << strerror(errno);
     return Status::Corruption(s.ToString());
   }
+  // Forget all cached rows of the old db
+  cache_space_ = ZPRowCache::NewSpace();
   LOG(WARNING) << "Success to Changedb: " << data_path_
     << ", table: "<< table_name_ << "_" << partition_id_;
   return Status::OK();
@@ -521,6 +542,16 @@ Status Partition::SlaveAskSync(const Node &node, BinlogOffset boffset) {
       << " Partition " << partition_id_ << " To "
       << node.ip << ":" << node.port << " at "
       << boffset.filenum << ", " << boffset.offset;
+    // Slave has everything before the sync point
+    std::vector<AckWaiter> done;
+    {
+      slash::MutexLock lm(&slave_ack_mu_);
+      slave_acks_[node] = boffset;
+      TakeAckWaiters(false, &done);
+    }
+    for (auto& waiter : done) {
+      waiter.done(true, waiter.acked);
+    }
   } else if (s.IsInvalidArgument()) {
     // Invalid filenum and offset
     LOG(WARNING) << "Failed AddBinlogSendTask for Table " << table_name_
@@ -539,6 +570,13 @@ Status Partition::SlaveAskSync(const Node &node, BinlogOffset boffset) {
 
 // Requeired: hold write lock of state_rw_
 void Partition::CleanSlaves(const std::set<Node> &old_slaves) {
+  {
+    slash::MutexLock lm(&slave_ack_mu_);
+    for (auto& old : old_slaves) {
+      slave_acks_.erase(old);
+      slave_stamps_.erase(old);
+    }
+  }
   for (auto& old : old_slaves) {
     LOG(INFO) << "Delete BinlogSendTask for Table " << table_name_
       << " Partition " << partition_id_ << " To "
@@ -572,6 +610,11 @@ void Partition::BecomeMaster() {
 
   // Record binlog offset when I win the master for the later slave sync
   GetBinlogOffset(&win_boffset_);
+
+  // Slaves should ack me from the begining
+  slash::MutexLock lm(&slave_ack_mu_);
+  slave_acks_.clear();
+  slave_stamps_.clear();
 }
 
 // Requeired: hold write lock of state_rw_
@@ -591,6 +634,7 @@ void Partition::BecomeSlave() {
   sync_lease_ = kBinlogDefaultLease;
   ResetRecoverSync();
   stuck_recover_sync_flag_ = 0;
+  last_caught_up_time_ = 0;
 }
 
 // Get binlog offset when I win the election
@@ -687,9 +731,10 @@ std::string NewPartitionPath(const std::string& name, const uint32_t current) {
 std::shared_ptr<Partition> NewPartition(const std::string &table_name,
     const std::string& log_path, const std::string& data_path,
     const std::string& trash_path,  const int partition_id,
-    const Node& master, const std::set<Node> &slaves) {
+    const Node& master, const std::set<Node> &slaves,
+    const std::shared_ptr<ZPTableQuota>& quota) {
   std::shared_ptr<Partition> partition(new Partition(table_name,
-      partition_id, log_path, data_path, trash_path));
+      partition_id, log_path, data_path, trash_path, quota));
   return partition;
 }
 
@@ -728,11 +773,12 @@ bool Partition::GetBinlogOffsetWithLock(BinlogOffset* boffset) {
 }
 
 // Required: hold read mutex of state_rw_
-bool Partition::GetBinlogOffset(BinlogOffset* boffset) const {
+bool Partition::GetBinlogOffset(BinlogOffset* boffset,
+    BinlogStamp* stamp) const {
   if (!opened_) {
     return false;
   }
-  logger_->GetProducerStatus(&boffset->filenum, &boffset->offset);
+  logger_->GetProducerStatus(&boffset->filenum, &boffset->offset, stamp);
   return true;
 }
 
@@ -742,7 +788,7 @@ bool Partition::CheckSyncOption(const PartitionSyncOption& option,
   // Check from node
   if (option.from_node != slash::IpPortString(master_node_.ip,
         master_node_.port)) {
-    LOG(WARNING) << "Discard binlog item from " << option.from_node
+    LOG_LIMITED(WARNING) << "Discard binlog item from " << option.from_node
       << ", partition:" << partition_id_
       << ", current my master is " << master_node_;
     return false;
@@ -752,7 +798,7 @@ bool Partition::CheckSyncOption(const PartitionSyncOption& option,
   if (!opened_
       || role_ != Role::kNodeSlave
       || repl_state_ != ReplState::kConnected) {
-    LOG(WARNING) << "Discard binlog item from " << option.from_node
+    LOG_LIMITED(WARNING) << "Discard binlog item from " << option.from_node
       << ", is opened:" << opened_
       << ", partition:" << partition_id_
       << ", my current role: " << RoleMsg[role_]
@@ -790,7 +836,8 @@ bool Partition::CheckSyncOption(const PartitionSyncOption& option,
 
 // Keep binlog order outside
 void Partition::DoBinlogCommand(const PartitionSyncOption& option,
-    const Cmd* cmd, const client::CmdRequest &req) {
+    const Cmd* cmd, const client::CmdRequest &req,
+    const std::string& item) {
   slash::RWLock l(&state_rw_, false);
   if (!CheckSyncOption(option)) {
     return;
@@ -802,31 +849,70 @@ void Partition::DoBinlogCommand(const PartitionSyncOption& option,
   if (!cmd->is_suspend()) {
     pthread_rwlock_rdlock(&suspend_rw_);
   }
+  uint64_t lock_us = slash::NowMicros() - start_us;
 
+  bool perf = ZPSlowlog::BeginPerf();
   client::CmdResponse res;
   cmd->Do(&req, &res, this);
+  uint64_t done_us = req.has_trace() ? slash::NowMicros() : 0;
 
   std::string raw;
-  req.SerializeToString(&raw);
-  Status s = logger_->Put(raw);
+  Status s;
+  if (!item.empty()) {
+    // Keep the same bytes as master, so that offsets stay the same
+    s = logger_->PutItem(item);
+  } else {
+    req.SerializeToString(&raw);
+    s = logger_->Put(raw, option.stamp);
+  }
   if (!s.ok()) {
-    LOG(WARNING) << "Binlog Put failed : " << s.ToString()
-      << ", table: " << table_name_
-      << ", partition: " << partition_id_
-      << ", content: [" << raw << "]";
+    if (!item.empty()) {
+      LOG_LIMITED(WARNING) << "Binlog Put failed : " << s.ToString()
+        << ", table: " << table_name_
+        << ", partition: " << partition_id_
+        << ", item size: " << item.size()
+        << ", seq: " << option.stamp.seq;
+    } else {
+      LOG_LIMITED(WARNING) << "Binlog Put failed : " << s.ToString()
+        << ", table: " << table_name_
+        << ", partition: " << partition_id_
+        << ", content: [" << raw << "]";
+    }
+  } else {
+    ScheduleBinlogAck();
   }
 
   if (!cmd->is_suspend()) {
     pthread_rwlock_unlock(&suspend_rw_);
   }
 
-  int64_t duration = slash::NowMicros() - start_us;
+  uint64_t end_us = slash::NowMicros();
+  if (req.has_trace()) {
+    // Apply on slave as a child of the command on master
+    ZPTrace trace(req.trace(), true, "Apply" + cmd->name());
+    trace.AddAttr("zp.table", table_name_);
+    trace.AddAttr("zp.partition", std::to_string(partition_id_));
+    trace.AddAttr("zp.from", option.from_node);
+    trace.AddSpan("suspend_lock", start_us, start_us + lock_us);
+    trace.AddSpan("db", start_us + lock_us, done_us);
+    trace.AddSpan("binlog", done_us, end_us);
+    trace.Finish(start_us, end_us);
+  }
+
+  int64_t duration = end_us - start_us;
   zp_data_server->PlusLatencyStat(
-    StatType::kSync, table_name_, cmd->type_, duration / 1000);
+    StatType::kSync, table_name_, cmd->type_, duration);
   if (duration > g_zp_conf->slowlog_slower_than()) {
-    LOG(WARNING) << "slow sync command:" << cmd->name()
+    LOG_LIMITED(WARNING) << "slow sync command:" << cmd->name()
       << ", duration(us): " << duration
       << ", For " << table_name_ << "_" << partition_id_;
+    if (ZPSlowlog::Enabled()) {
+      AddSlowlog(cmd, cmd->ExtractKey(&req), true, duration, 0, lock_us,
+          perf);
+    }
+  }
+  if (perf) {
+    ZPSlowlog::EndPerf(NULL);
   }
 }
 
@@ -840,31 +926,450 @@ void Partition::DoBinlogSkip(const PartitionSyncOption& option,
 
   Status s = logger_->PutBlank(gap);
   if (!s.ok()) {
-    LOG(WARNING) << "Binlog PutBlank failed : " << s.ToString()
+    LOG_LIMITED(WARNING) << "Binlog PutBlank failed : " << s.ToString()
       << ", table: " << table_name_
       << ", partition: " << partition_id_
       << ", gap: " << gap;
+  } else {
+    ScheduleBinlogAck();
   }
 }
 
 void Partition::DoBinlogLeaseRenew(const PartitionSyncOption& option,
-    uint64_t lease) {
+    uint64_t lease, bool caught_up, uint64_t recv_us) {
   slash::RWLock l(&state_rw_, false);
   if (!CheckSyncOption(option, false)) {
     return;
   }
   sync_lease_ = lease;
+  if (caught_up && recv_us > last_caught_up_time_) {
+    // All binlog sent before has been applied, since they are
+    // handled in order by the same bgworker. Take the time it was
+    // received rather than now, our data is no newer than master's
+    // then however long it waited in queue
+    last_caught_up_time_ = recv_us;
+  }
+}
+
+// Whether a slave could serve this read command.
+// Our data is no older than master's at last_caught_up_time_,
+// and contains all binlog before our current offset
+// Required: hold read lock of state_rw_
+bool Partition::FollowerReadable(const Cmd* cmd,
+    const client::CmdRequest &req) {
+  if (cmd->is_write()
+      || req.type() != client::Type::GET
+      || (!req.get().has_max_lag_ms() && !req.get().has_min_offset())) {
+    return false;
+  }
+  if (role_ != Role::kNodeSlave
+      || repl_state_ != ReplState::kConnected) {
+    return false;
+  }
+
+  uint64_t now = slash::NowMicros();
+  if (now - last_sync_time_ > sync_lease_ * 1000 * 1000) {
+    // Lease from master expired
+    return false;
+  }
+
+  if (req.get().has_max_lag_ms()) {
+    uint64_t caught_up_time = last_caught_up_time_;
+    uint64_t max_lag_us =
+      static_cast<uint64_t>(std::max(req.get().max_lag_ms(), 0)) * 1000;
+    if (caught_up_time == 0
+        || caught_up_time > now
+        || now - caught_up_time > max_lag_us) {
+      return false;
+    }
+  }
+
+  if (req.get().has_min_offset()) {
+    BinlogOffset cur;
+    BinlogOffset token(req.get().min_offset().filenum(),
+        req.get().min_offset().offset());
+    if (!GetBinlogOffset(&cur) || cur < token) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Required: hold read lock of state_rw_
+void Partition::ScheduleBinlogAck(uint64_t delay) {
+  if (!ack_pending_.exchange(true)) {
+    zp_data_server->AddBinlogAckTask(table_name_, partition_id_, delay);
+  }
+}
+
+// As slave, get master and applied offset to ack
+// Return false if no ack is needed
+bool Partition::GetBinlogAck(Node* master, BinlogOffset* applied,
+    BinlogStamp* stamp) {
+  // Later apply should schedule a new one
+  ack_pending_ = false;
+  slash::RWLock l(&state_rw_, false);
+  if (role_ != Role::kNodeSlave
+      || repl_state_ != ReplState::kConnected) {
+    return false;
+  }
+  *master = master_node_;
+  return GetBinlogOffset(applied, stamp);
+}
+
+// As slave, the last ack failed to reach master, send again later,
+// or master may never know what we applied if no more binlog comes
+void Partition::RetryBinlogAck() {
+  slash::RWLock l(&state_rw_, false);
+  ScheduleBinlogAck(kBinlogAckRetryDelay);
+}
+
+// As master, receive applied offset from slave
+void Partition::DoBinlogAck(const Node& node, const BinlogOffset& applied,
+    const BinlogStamp& stamp) {
+  slash::RWLock l(&state_rw_, false);
+  if (!opened_
+      || role_ != Role::kNodeMaster
+      || slave_nodes_.find(node) == slave_nodes_.end()) {
+    DLOG(WARNING) << "Discard binlog ack from " << node
+      << ", table: " << table_name_ << ", partition: " << partition_id_;
+    return;
+  }
+  std::vector<AckWaiter> done;
+  {
+    slash::MutexLock lm(&slave_ack_mu_);
+    slave_acks_[node] = applied;
+    if (stamp.seq > 0) {
+      slave_stamps_[node] = stamp;
+    }
+    TakeAckWaiters(false, &done);
+  }
+  for (auto& waiter : done) {
+    waiter.done(true, waiter.acked);
+  }
+}
+
+// Required: hold slave_ack_mu_
+int Partition::CountSlaveAck(const std::set<Node>& slaves,
+    const BinlogOffset& target) {
+  int acked = 0;
+  for (auto& node : slaves) {
+    auto it = slave_acks_.find(node);
+    if (it != slave_acks_.end() && !(it->second < target)) {
+      acked++;
+    }
+  }
+  return acked;
+}
+
+// Required: hold slave_ack_mu_
+void Partition::TakeAckWaiters(bool expire_all,
+    std::vector<AckWaiter>* done) {
+  uint64_t now = slash::NowMicros();
+  auto it = ack_waiters_.begin();
+  while (it != ack_waiters_.end()) {
+    int acked = CountSlaveAck(it->slaves, it->target);
+    if (expire_all
+        || now >= it->deadline_us
+        || acked >= it->num) {
+      done->push_back(*it);
+      done->back().acked = acked;
+      it = ack_waiters_.erase(it);
+    } else {
+      ++it;
+    }
+  }
+}
+
+struct AckWaitArg {
+  std::string table_name;
+  int partition_id;
+  AckWaitArg(const std::string& table, int id)
+    : table_name(table), partition_id(id) {}
+};
+
+static void DoExpireAckWaiters(void* arg) {
+  AckWaitArg* warg = static_cast<AckWaitArg*>(arg);
+  std::shared_ptr<Partition> partition = zp_data_server->GetTablePartitionById(
+      warg->table_name, warg->partition_id);
+  if (partition != NULL) {
+    partition->ExpireAckWaiters();
+  }
+  delete warg;
+}
+
+// Wait until no less than num slaves have applied binlog up to target,
+// or timeout. The waiter is parked, so that no thread is blocked
+void Partition::WaitSlaveAck(const BinlogOffset& target, int num,
+    int timeout_ms, const AckWaitDone& done) {
+  AckWaiter waiter;
+  bool is_master = false;
+  {
+    slash::RWLock l(&state_rw_, false);
+    if (opened_ && role_ == Role::kNodeMaster) {
+      is_master = true;
+      waiter.slaves = slave_nodes_;
+    }
+  }
+  if (!is_master) {
+    done(false, 0);
+    return;
+  }
+
+  int acked = 0;
+  {
+    slash::MutexLock lm(&slave_ack_mu_);
+    acked = CountSlaveAck(waiter.slaves, target);
+    if (acked < num && timeout_ms > 0) {
+      waiter.target = target;
+      waiter.num = num;
+      waiter.deadline_us = slash::NowMicros()
+        + static_cast<uint64_t>(timeout_ms) * 1000;
+      waiter.done = done;
+      waiter.acked = 0;
+      ack_waiters_.push_back(waiter);
+    }
+  }
+  if (acked < num && timeout_ms > 0) {
+    // One more milli second, so that the deadline has passed for sure
+    zp_data_server->AckWaitTimerSchedule(timeout_ms + 1, &DoExpireAckWaiters,
+        new AckWaitArg(table_name_, partition_id_));
+    return;
+  }
+  done(true, acked);
+}
+
+// Called by timer, or on exit with all waiters expired
+void Partition::ExpireAckWaiters(bool expire_all) {
+  std::vector<AckWaiter> done;
+  {
+    slash::MutexLock lm(&slave_ack_mu_);
+    TakeAckWaiters(expire_all, &done);
+  }
+  for (auto& waiter : done) {
+    waiter.done(true, waiter.acked);
+  }
+}
+
+// Required: hold read lock of state_rw_, and partition is opened
+// Refreshed from db properties at most once every kStallCheckInterval
+int Partition::GetStallLevel() {
+  uint64_t now = slash::NowMicros();
+  uint64_t last = stall_check_time_;
+  if (now < last + kStallCheckInterval * 1000
+      || !stall_check_time_.compare_exchange_strong(last, now)) {
+    return stall_level_;
+  }
+
+  const rocksdb::Options* options = zp_data_server->db_options();
+  uint64_t stopped = 0, delayed_rate = 0, pending_bytes = 0, imm_num = 0;
+  std::string l0_files;
+  db_->GetIntProperty(rocksdb::DB::Properties::kIsWriteStopped, &stopped);
+  db_->GetIntProperty(rocksdb::DB::Properties::kActualDelayedWriteRate,
+      &delayed_rate);
+  db_->GetIntProperty(
+      rocksdb::DB::Properties::kEstimatePendingCompactionBytes,
+      &pending_bytes);
+  db_->GetIntProperty(rocksdb::DB::Properties::kNumImmutableMemTable,
+      &imm_num);
+  db_->GetProperty(rocksdb::DB::Properties::kNumFilesAtLevelPrefix + "0",
+      &l0_files);
+  int l0_num = atoi(l0_files.c_str());
+
+  int level = kStallNone;
+  if (stopped
+      || l0_num >= options->level0_stop_writes_trigger
+      || (options->hard_pending_compaction_bytes_limit > 0
+        && pending_bytes >= options->hard_pending_compaction_bytes_limit)) {
+    level = kStallStop;
+  } else if (delayed_rate > 0
+      // Shed a little earlier than rocksdb begins to delay
+      || l0_num >= options->level0_slowdown_writes_trigger * 3 / 4
+      || (options->soft_pending_compaction_bytes_limit > 0
+        && pending_bytes
+          >= options->soft_pending_compaction_bytes_limit * 3 / 4)
+      || imm_num + 1 >= static_cast<uint64_t>(
+        std::max(options->max_write_buffer_number - 1, 1))
+      || (options->write_buffer_manager
+        && options->write_buffer_manager->enabled()
+        && options->write_buffer_manager->memory_usage()
+          >= options->write_buffer_manager->buffer_size() * 9 / 10)) {
+    level = kStallDelay;
+  }
+
+  if (level != stall_level_) {
+    LOG(WARNING) << "Partition " << table_name_ << "_" << partition_id_
+      << " write stall changed to " << StallLevelMsg[level]
+      << ", L0 files: " << l0_num << ", pending compaction: " << pending_bytes
+      << ", immutable memtables: " << imm_num
+      << ", delayed rate: " << delayed_rate;
+    stall_level_ = level;
+  }
+  return level;
+}
+
+// Required: hold read lock of state_rw_, and partition is opened
+// stall_writers_ should be decreased after the write if return true
+bool Partition::AdmitWrite() {
+  int level = GetStallLevel();
+  if (level == kStallStop) {
+    return false;
+  }
+  int writers = ++stall_writers_;
+  if (level == kStallDelay && writers > kStallMaxWriters) {
+    stall_writers_--;
+    return false;
+  }
+  return true;
+}
+
+// Distance in bytes from one binlog offset to a later one
+static uint64_t BinlogDistance(const BinlogOffset& from,
+    const BinlogOffset& to) {
+  if (!(from < to)) {
+    return 0;
+  }
+  return (to.filenum - from.filenum) * kBinlogSize + to.offset - from.offset;
+}
+
+// How far the applied stamp is behind the produced one
+static uint64_t StampLagMs(const BinlogStamp& applied,
+    const BinlogStamp& produced) {
+  if (applied.seq >= produced.seq || applied.time_us >= produced.time_us) {
+    return 0;
+  }
+  return (produced.time_us - applied.time_us) / 1000;
+}
+
+static uint64_t StampLagRecords(const BinlogStamp& applied,
+    const BinlogStamp& produced) {
+  return applied.seq >= produced.seq ? 0 : produced.seq - applied.seq;
+}
+
+// Called every cron, measure how fast the slowest slave catches up
+void Partition::UpdateCatchupRate() {
+  BinlogOffset produced, min_ack;
+  {
+    slash::RWLock l(&state_rw_, false);
+    if (!opened_
+        || role_ != Role::kNodeMaster
+        || slave_nodes_.empty()) {
+      slave_lag_ = 0;
+      catchup_rate_ = 0;
+      last_rate_time_ = 0;
+      return;
+    }
+    GetBinlogOffset(&produced);
+    slash::MutexLock lm(&slave_ack_mu_);
+    bool first = true;
+    for (auto& node : slave_nodes_) {
+      auto it = slave_acks_.find(node);
+      BinlogOffset acked =
+        (it == slave_acks_.end()) ? BinlogOffset() : it->second;
+      if (first || acked < min_ack) {
+        min_ack = acked;
+        first = false;
+      }
+    }
+  }
+
+  uint64_t now = slash::NowMicros();
+  slave_lag_ = BinlogDistance(min_ack, produced);
+  if (last_rate_time_ > 0 && now > last_rate_time_) {
+    catchup_rate_ = BinlogDistance(last_min_ack_, min_ack) * 1000000
+      / (now - last_rate_time_);
+  }
+  last_min_ack_ = min_ack;
+  last_rate_time_ = now;
 }
 
-void Partition::DoCommand(const Cmd* cmd, const client::CmdRequest &req,
-    client::CmdResponse *res) {
+// As master in SLOWDOWN, delay writes so that binlog grows slower than
+// the slowest slave catches up, which makes handover converge.
+// *delay_us is how long the write has to wait for its turn, which is only
+// taken if can_wait, by at most kSlowdownQueueSize writes together.
+// Return false if refused, *delay_us is the retry hint then
+bool Partition::PaceWrite(const client::CmdRequest &req, bool can_wait,
+    uint64_t* delay_us) {
+  *delay_us = 0;
+  {
+    slash::RWLock l(&state_rw_, false);
+    if (pstate_ != ZPMeta::PState::SLOWDOWN
+        || role_ != Role::kNodeMaster) {
+      return true;
+    }
+  }
+  if (slave_lag_ == 0) {
+    // Nothing to catch up
+    return true;
+  }
+
+  uint64_t rate = catchup_rate_
+    * (100 - g_zp_conf->slowdown_delay_radio()) / 100;
+  rate = std::max(rate, kSlowdownMinRate);
+  uint64_t cost = static_cast<uint64_t>(req.ByteSize()) * 1000000 / rate;
+  uint64_t now = slash::NowMicros();
+  slash::MutexLock l(&pace_mu_);
+  while (!pace_turns_.empty() && pace_turns_.front() <= now) {
+    pace_turns_.pop_front();
+  }
+  uint64_t start = std::max(now, pace_next_us_);
+  *delay_us = start - now;
+  if (*delay_us > 0
+      && (!can_wait
+        || *delay_us > static_cast<uint64_t>(kSlowdownMaxDelay) * 1000
+        || pace_turns_.size() >= static_cast<size_t>(kSlowdownQueueSize))) {
+    return false;
+  }
+  pace_next_us_ = start + cost;
+  if (*delay_us > 0) {
+    pace_turns_.push_back(start);
+  }
+  return true;
+}
+
+bool Partition::DoCommand(const Cmd* cmd, const client::CmdRequest &req,
+    client::CmdResponse *res, uint64_t queue_us, const Slice& wire,
+    uint64_t* paced_us) {
   std::string key = cmd->ExtractKey(&req);
+  uint64_t begin_us = slash::NowMicros();
 
-  zp_data_server->PlusQueryStat(StatType::kClient, table_name_);
+  if (paced_us == NULL || *paced_us == 0) {
+    // Counted once, not again when it comes back paced
+    zp_data_server->PlusQueryStat(StatType::kClient, table_name_);
+  }
 
+  if (req.has_deadline_us()
+      && slash::NowMicros() > static_cast<uint64_t>(req.deadline_us())) {
+    // Expired while waiting in queue
+    zp_data_server->PlusExpiredStat(StatType::kClient, table_name_);
+    res->set_type(req.type());
+    res->set_code(client::StatusCode::kTimeout);
+    res->set_msg("deadline exceeded");
+    return true;
+  }
+
+  // Never wait here, the turn is taken and waited by the caller
+  uint64_t delay_us = (paced_us == NULL) ? 0 : *paced_us;
+  if (cmd->is_write() && delay_us == 0) {
+    if (!PaceWrite(req, paced_us != NULL, &delay_us)) {
+      res->set_type(req.type());
+      res->set_code(client::StatusCode::kWait);
+      res->set_msg("partition slowdown");
+      res->set_delay_us(delay_us);
+      return true;
+    }
+    if (delay_us > 0) {
+      *paced_us = delay_us;
+      return false;
+    }
+  }
+
+  uint64_t lock_begin_us = slash::NowMicros();
   slash::RWLock l(&state_rw_, false);
+  uint64_t state_locked_us = slash::NowMicros();
+  uint64_t lock_us = state_locked_us - lock_begin_us;
   if (!opened_
-      || role_ != Role::kNodeMaster) {
+      || (role_ != Role::kNodeMaster && !FollowerReadable(cmd, req))) {
     res->set_type(req.type());
     res->set_code(client::StatusCode::kMove);
     res->set_msg("Command Redirect");
@@ -876,25 +1381,51 @@ void Partition::DoCommand(const Cmd* cmd, const client::CmdRequest &req,
     DLOG(WARNING) << "Should redirect, failed to DoCommand  at table: "
       << table_name_ << ", Partition: " << partition_id_
       << " Role:" << RoleMsg[role_] << " redirect to master:" << node;
-    return;
+    return true;
   }
 
   if (cmd->is_write()
-      && (pstate_ == ZPMeta::PState::STUCK
-        || (pstate_ == ZPMeta::PState::SLOWDOWN
-          && slash::NowMicros() % 100 > static_cast<uint64_t>(
-            g_zp_conf->slowdown_delay_radio())))) {
-    // Have some chance survive, about 1 - slowdown_delay_radio
-
+      && pstate_ == ZPMeta::PState::STUCK) {
     res->set_type(req.type());
     res->set_code(client::StatusCode::kWait);
-    res->set_msg("partition slowdown or stuck");
+    res->set_msg("partition stuck");
 
-    DLOG(WARNING) << "Partition Slowdown or Stuck, failed to DoCommand"
+    DLOG(WARNING) << "Partition Stuck, failed to DoCommand"
       << ", Table: " << table_name_ << ", Partition: " << partition_id_
       << ", Role:" << RoleMsg[role_] << " ParititionState:"
       << static_cast<int>(pstate_);
-    return;
+    return true;
+  }
+
+  // Shed writes before blocking in a stalled db
+  if (cmd->is_write() && !AdmitWrite()) {
+    res->set_type(req.type());
+    res->set_code(client::StatusCode::kWait);
+    res->set_msg("db write stall");
+    res->set_delay_us(kStallRetryDelay * 1000);
+
+    DLOG(WARNING) << "Partition write stall, failed to DoCommand"
+      << ", Table: " << table_name_ << ", Partition: " << partition_id_
+      << ", Stall: " << StallLevelMsg[stall_level_];
+    return true;
+  }
+
+  // Only data commands are limited by the table quota, which is charged
+  // only once the command is sure to go
+  bool limited = (cmd->flag_type() == kCmdFlagsKv);
+  if (limited
+      && !quota_->Acquire(cmd->is_write(),
+        cmd->is_write() ? req.ByteSize() : 0)) {
+    if (cmd->is_write()) {
+      stall_writers_--;
+    }
+    res->set_type(req.type());
+    res->set_code(client::StatusCode::kThrottle);
+    res->set_msg("table over quota");
+
+    DLOG(WARNING) << "Table over quota, failed to DoCommand"
+      << ", Table: " << table_name_ << ", Partition: " << partition_id_;
+    return true;
   }
 
   uint64_t start_us = slash::NowMicros();
@@ -907,32 +1438,117 @@ void Partition::DoCommand(const Cmd* cmd, const client::CmdRequest &req,
   if (cmd->is_write()) {
     mutex_record_.Lock(key);
   }
+  uint64_t locked_us = slash::NowMicros();
+  lock_us += locked_us - start_us;
 
+  bool perf = ZPSlowlog::BeginPerf();
   cmd->Do(&req, res, this);
+  if (delay_us > 0) {
+    res->set_delay_us(delay_us);
+  }
+  uint64_t done_us = req.has_trace() ? slash::NowMicros() : 0;
 
   if (cmd->is_write()) {
     if (res->code() == client::StatusCode::kOk) {
       // Restore Message
       std::string raw;
-      if (cmd->GenerateLog(&req, &raw)) {
-        logger_->Put(raw);
+      uint32_t filenum = 0;
+      uint64_t offset = 0;
+      // Compression and compact record are told in the stamp header
+      bool stamp = g_zp_conf->binlog_stamp();
+      int flags = stamp && g_zp_conf->binlog_compression()
+        ? kBinlogItemSnappy : 0;
+      Slice parts[2];
+      int part_num = 0;
+      if (stamp && g_zp_conf->binlog_compact_record()
+          && EncodeBinlogRecord(req, &raw)) {
+        flags |= kBinlogItemCompact;
+        parts[part_num++] = Slice(raw.data(), raw.size());
+      } else if (!wire.empty() && cmd->GenerateLogPatch(&req, &raw)) {
+        // Log the received bytes without serialize again
+        parts[part_num++] = wire;
+        parts[part_num++] = Slice(raw.data(), raw.size());
+      } else if (cmd->GenerateLog(&req, &raw)) {
+        parts[part_num++] = Slice(raw.data(), raw.size());
+      }
+      if (part_num > 0
+          && logger_->Put(parts, part_num, stamp, flags,
+            &filenum, &offset).ok()) {
+        // Token for later WAIT or GET from slave
+        client::SyncOffset* boffset = res->mutable_binlog_offset();
+        boffset->set_partition(partition_id_);
+        boffset->set_filenum(filenum);
+        boffset->set_offset(offset);
       }
     }
     mutex_record_.Unlock(key);
+    stall_writers_--;
   }
+  uint64_t logged_us = req.has_trace() ? slash::NowMicros() : 0;
 
   if (!cmd->is_suspend()) {
     pthread_rwlock_unlock(&suspend_rw_);
   }
 
-  int64_t duration = slash::NowMicros() - start_us;
+  if (limited && !cmd->is_write()
+      && res->code() == client::StatusCode::kOk) {
+    // Size of read is known only now
+    quota_->Charge(false, res->ByteSize());
+  }
+
+  uint64_t end_us = slash::NowMicros();
+  if (req.has_trace()) {
+    ZPTrace trace(req.trace(), false, cmd->name());
+    trace.AddAttr("zp.table", table_name_);
+    trace.AddAttr("zp.partition", std::to_string(partition_id_));
+    trace.AddAttr("zp.code", client::StatusCode_Name(res->code()));
+    // Pacing, if any, is the last part of queue_us
+    trace.AddSpan("queue", begin_us - queue_us, begin_us - delay_us);
+    if (delay_us > 0) {
+      trace.AddSpan("pace", begin_us - delay_us, begin_us);
+    }
+    trace.AddSpan("state_lock", lock_begin_us, state_locked_us);
+    trace.AddSpan("key_lock", start_us, locked_us);
+    trace.AddSpan("db", locked_us, done_us);
+    trace.AddSpan("binlog", done_us, logged_us);
+    trace.Finish(begin_us - queue_us, end_us);
+  }
+
+  int64_t duration = end_us - start_us;
   zp_data_server->PlusLatencyStat(
-    StatType::kClient, table_name_, cmd->type_, duration / 1000);
+    StatType::kClient, table_name_, cmd->type_, duration);
   if (duration > g_zp_conf->slowlog_slower_than()) {
-    LOG(WARNING) << "slow client command:" << cmd->name()
+    LOG_LIMITED(WARNING) << "slow client command:" << cmd->name()
       << ", duration(us): " << duration
       << ", For " << table_name_ << "_" << partition_id_;
+    if (ZPSlowlog::Enabled()) {
+      AddSlowlog(cmd, key, false, duration, queue_us, lock_us, perf);
+    }
+  }
+  if (perf) {
+    ZPSlowlog::EndPerf(NULL);
   }
+  return true;
+}
+
+// Required: perf counted since the command begins, if perf
+void Partition::AddSlowlog(const Cmd* cmd, const std::string& key,
+    bool from_sync, uint64_t duration_us, uint64_t queue_us,
+    uint64_t lock_us, bool perf) {
+  SlowlogEntry entry;
+  entry.time = time(NULL);
+  entry.cmd = cmd->name();
+  entry.table_name = table_name_;
+  entry.partition_id = partition_id_;
+  entry.key = key.substr(0, kSlowlogKeyLen);
+  entry.from_sync = from_sync;
+  entry.duration_us = duration_us;
+  entry.queue_us = queue_us;
+  entry.lock_us = lock_us;
+  if (perf) {
+    ZPSlowlog::EndPerf(&entry.perf);
+  }
+  zp_data_server->slowlog()->Add(&entry);
 }
 
 inline void Partition::TryRecoverSync() {
@@ -992,6 +1608,18 @@ bool Partition::NeedRecoverSync() {
 }
 
 void Partition::DoTimingTask() {
+  UpdateCatchupRate();
+
+  {
+    // Next binlog file is ready before roll, and writeback is
+    // started here rather than by writers holding binlog lock
+    slash::RWLock l(&state_rw_, false);
+    if (opened_) {
+      logger_->SyncRange();
+      logger_->PrepareNext();
+    }
+  }
+
   // Purge log
   if (!PurgeLogs(0, false)) {
     return;
@@ -1359,6 +1987,98 @@ void Partition::Dump() {
   }
 }
 
+void Partition::CollectMetrics(ZPMetrics* metrics) {
+  ZPMetrics::Labels labels = {
+    {"table", table_name_},
+    {"partition", std::to_string(partition_id_)}
+  };
+  slash::RWLock l(&state_rw_, false);
+  if (!opened_) {
+    return;
+  }
+
+  ZPMetrics::Labels role_labels(labels);
+  role_labels.push_back(std::make_pair("role", RoleMsg[role_]));
+  metrics->Declare("zp_partition_role", "gauge",
+      "Role of partition on this node");
+  metrics->Add("zp_partition_role", role_labels, 1);
+  metrics->Declare("zp_partition_stuck", "gauge",
+      "Whether partition is stuck by meta");
+  metrics->Add("zp_partition_stuck", labels,
+      pstate_ == ZPMeta::PState::STUCK ? 1 : 0);
+  metrics->Declare("zp_partition_write_stall", "gauge",
+      "Write stall level, 0 none, 1 delay, 2 stop");
+  metrics->Add("zp_partition_write_stall", labels, stall_level_);
+
+  BinlogOffset boffset;
+  BinlogStamp stamp;
+  GetBinlogOffset(&boffset, &stamp);
+  metrics->Declare("zp_binlog_filenum", "gauge", "Current binlog file");
+  metrics->Add("zp_binlog_filenum", labels, boffset.filenum);
+  metrics->Declare("zp_binlog_offset", "gauge",
+      "Offset in current binlog file");
+  metrics->Add("zp_binlog_offset", labels, boffset.offset);
+
+  if (role_ == Role::kNodeMaster) {
+    metrics->Declare("zp_slave_lag_bytes", "gauge",
+        "Binlog bytes not applied by slave yet");
+    metrics->Declare("zp_slave_lag_ms", "gauge",
+        "Time between binlog items last written and applied by slave");
+    metrics->Declare("zp_slave_lag_records", "gauge",
+        "Binlog items not applied by slave yet");
+    slash::MutexLock lm(&slave_ack_mu_);
+    for (auto& node : slave_nodes_) {
+      auto it = slave_acks_.find(node);
+      BinlogOffset acked =
+        (it == slave_acks_.end()) ? BinlogOffset() : it->second;
+      ZPMetrics::Labels slave_labels(labels);
+      slave_labels.push_back(std::make_pair("slave",
+            slash::IpPortString(node.ip, node.port)));
+      metrics->Add("zp_slave_lag_bytes", slave_labels,
+          BinlogDistance(acked, boffset));
+      auto st = slave_stamps_.find(node);
+      if (stamp.seq > 0 && st != slave_stamps_.end()) {
+        metrics->Add("zp_slave_lag_ms", slave_labels,
+            StampLagMs(st->second, stamp));
+        metrics->Add("zp_slave_lag_records", slave_labels,
+            StampLagRecords(st->second, stamp));
+      }
+    }
+    metrics->Declare("zp_slave_catchup_rate", "gauge",
+        "Bytes per second the slowest slave catches up");
+    metrics->Add("zp_slave_catchup_rate", labels, catchup_rate_);
+  }
+
+  // DB properties
+  static const std::pair<std::string, std::string> kDBProperties[] = {
+    {rocksdb::DB::Properties::kEstimateNumKeys, "zp_db_estimate_keys"},
+    {rocksdb::DB::Properties::kCurSizeAllMemTables, "zp_db_memtable_bytes"},
+    {rocksdb::DB::Properties::kNumImmutableMemTable,
+      "zp_db_immutable_memtables"},
+    {rocksdb::DB::Properties::kEstimatePendingCompactionBytes,
+      "zp_db_pending_compaction_bytes"},
+    {rocksdb::DB::Properties::kNumRunningCompactions,
+      "zp_db_running_compactions"},
+    {rocksdb::DB::Properties::kNumRunningFlushes, "zp_db_running_flushes"},
+    {rocksdb::DB::Properties::kActualDelayedWriteRate,
+      "zp_db_delayed_write_rate"},
+    {rocksdb::DB::Properties::kIsWriteStopped, "zp_db_write_stopped"},
+  };
+  for (auto& property : kDBProperties) {
+    uint64_t value = 0;
+    if (db_->GetIntProperty(property.first, &value)) {
+      metrics->Declare(property.second, "gauge", property.first);
+      metrics->Add(property.second, labels, value);
+    }
+  }
+  std::string l0_files;
+  if (db_->GetProperty(rocksdb::DB::Properties::kNumFilesAtLevelPrefix + "0",
+        &l0_files)) {
+    metrics->Declare("zp_db_level0_files", "gauge", "Files at level 0");
+    metrics->Add("zp_db_level0_files", labels, atoi(l0_files.c_str()));
+  }
+}
+
 bool Partition::GetState(client::PartitionState* state) {
   state->set_partition_id(partition_id_);
   slash::RWLock l(&state_rw_, false);
@@ -1378,9 +2098,30 @@ bool Partition::GetState(client::PartitionState* state) {
   // SyncOffset
   client::SyncOffset* sync_offset = state->mutable_sync_offset();
   BinlogOffset boffset;
-  GetBinlogOffset(&boffset);
+  BinlogStamp stamp;
+  GetBinlogOffset(&boffset, &stamp);
   sync_offset->set_filenum(boffset.filenum);
   sync_offset->set_offset(boffset.offset);
+  if (stamp.seq > 0) {
+    state->mutable_stamp()->set_seq(stamp.seq);
+    state->mutable_stamp()->set_time_us(stamp.time_us);
+  }
+
+  // Lag of slaves
+  if (role_ == Role::kNodeMaster && stamp.seq > 0) {
+    slash::MutexLock lm(&slave_ack_mu_);
+    for (auto& node : slave_nodes_) {
+      auto it = slave_stamps_.find(node);
+      if (it == slave_stamps_.end()) {
+        continue;
+      }
+      client::SlaveLag* lag = state->add_slave_lags();
+      lag->mutable_node()->set_ip(node.ip);
+      lag->mutable_node()->set_port(node.port);
+      lag->set_lag_ms(StampLagMs(it->second, stamp));
+      lag->set_lag_records(StampLagRecords(it->second, stamp));
+    }
+  }
 
   // Fallback
   if (role_ == Role::kNodeSlave) {
@@ -13,6 +13,8 @@
 #ifndef SRC_NODE_ZP_DATA_PARTITION_H_
 #define SRC_NODE_ZP_DATA_PARTITION_H_
 
+#include <list>
+#include <deque>
 #include <memory>
 #include <functional>
 #include <unordered_set>
@@ -30,15 +32,20 @@
 #include "include/zp_conf.h"
 #include "include/zp_binlog.h"
 #include "include/zp_command.h"
+#include "include/zp_metrics.h"
 #include "src/node/client.pb.h"
 #include "src/node/zp_data_entity.h"
+#include "src/node/zp_single_flight.h"
+#include "src/node/zp_slowlog.h"
+#include "src/node/zp_table_quota.h"
 
 class Partition;
 std::string NewPartitionPath(const std::string& name, const uint32_t current);
 std::shared_ptr<Partition> NewPartition(const std::string &table_name,
     const std::string& log_path, const std::string& data_path,
     const std::string& trash_path, const int partition_id,
-    const Node& master, const std::set<Node> &slaves);
+    const Node& master, const std::set<Node> &slaves,
+    const std::shared_ptr<ZPTableQuota>& quota);
 
 enum Role {
   kNodeSingle = 0,
@@ -64,6 +71,18 @@ const std::string ReplStateMsg[] = {
   "kWaitDBSync"
 };
 
+// Write stall of db
+enum StallLevel {
+  kStallNone = 0,
+  kStallDelay = 1,  // db delays writes, or is about to
+  kStallStop = 2,   // db stops writes
+};
+const std::string StallLevelMsg[] = {
+  "kStallNone",
+  "kStallDelay",
+  "kStallStop"
+};
+
 // Slave item
 struct SlaveItem {
   Node node;
@@ -119,6 +138,7 @@ struct PartitionSyncOption {
   std::string from_node;
   uint32_t filenum;
   uint64_t offset;
+  BinlogStamp stamp;  // of the item in CMD
   PartitionSyncOption(
       client::SyncType t,
       std::string table,
@@ -170,7 +190,8 @@ class Partition  {
  public:
   Partition(const std::string& table_name, const int partition_id,
       const std::string& log_path, const std::string& data_path,
-      const std::string& trash_path);
+      const std::string& trash_path,
+      const std::shared_ptr<ZPTableQuota>& quota);
   ~Partition();
 
   int partition_id() const {
@@ -188,6 +209,19 @@ class Partition  {
     return db_;
   }
 
+  ZPSingleFlight* get_flight() {
+    return &get_flight_;
+  }
+
+  // Key of row cache, prefixed by the cache space of current db
+  // Requeired: hold read lock of state_rw_, and partition is opened
+  std::string RowCacheKey(const std::string& key) const {
+    std::string cache_key(reinterpret_cast<const char*>(&cache_space_),
+        sizeof(cache_space_));
+    cache_key.append(key);
+    return cache_key;
+  }
+
   Node master_node() {
     slash::RWLock l(&state_rw_, false);
     return master_node_;
@@ -199,12 +233,36 @@ class Partition  {
   }
 
   // Command related
+  // item is the binlog item from master, request is logged if empty
   void DoBinlogCommand(const PartitionSyncOption& option,
-      const Cmd* cmd, const client::CmdRequest &req);
-  void DoCommand(const Cmd* cmd, const client::CmdRequest &req,
-      client::CmdResponse *res);
+      const Cmd* cmd, const client::CmdRequest &req,
+      const std::string& item);
+  // queue_us is how long the command waited before execution,
+  // wire is the request bytes as received, if not changed after parse.
+  // A write of a SLOWDOWN master may have to wait for its turn. With
+  // paced_us pointing to 0, the turn is taken and false is returned, the
+  // caller should DoCommand again *paced_us later with the same paced_us.
+  // Without paced_us, the write is refused with a retry hint instead
+  bool DoCommand(const Cmd* cmd, const client::CmdRequest &req,
+      client::CmdResponse *res, uint64_t queue_us = 0,
+      const Slice& wire = Slice(), uint64_t* paced_us = NULL);
   void DoBinlogSkip(const PartitionSyncOption& option, uint64_t gap);
-  void DoBinlogLeaseRenew(const PartitionSyncOption& option, uint64_t lease);
+  void DoBinlogLeaseRenew(const PartitionSyncOption& option, uint64_t lease,
+      bool caught_up, uint64_t recv_us);
+
+  // Slave ack related
+  void DoBinlogAck(const Node& node, const BinlogOffset& applied,
+      const BinlogStamp& stamp);
+  // Called once num slaves have applied the target, or at timeout, with
+  // the number of slaves acked. is_master is false if I'm not the master
+  typedef std::function<void(bool is_master, int acked)> AckWaitDone;
+  // Never block, done is called by whoever receives the ack,
+  // by the timer, or right now if no need to wait
+  void WaitSlaveAck(const BinlogOffset& target, int num, int timeout_ms,
+      const AckWaitDone& done);
+  void ExpireAckWaiters(bool expire_all = false);
+  bool GetBinlogAck(Node* master, BinlogOffset* applied, BinlogStamp* stamp);
+  void RetryBinlogAck();
 
   // Status related
   bool ShouldTrySync();
@@ -229,6 +287,7 @@ class Partition  {
   void Dump();
   bool GetWinBinlogOffset(BinlogOffset* win);
   bool GetState(client::PartitionState* state);
+  void CollectMetrics(ZPMetrics* metrics);
 
   void DoTimingTask();
 
@@ -262,16 +321,29 @@ class Partition  {
 
   // DB related
   rocksdb::DBNemo *db_;
+  uint64_t cache_space_;  // renewed whenever db_ is opened
 
   // Binlog related
   Binlog* logger_;
   bool CheckBinlogFiles();  // Check binlog availible and update purge_index_
   Status SetBinlogOffset(const BinlogOffset& target);
-  bool GetBinlogOffset(BinlogOffset* boffset) const;
+  bool GetBinlogOffset(BinlogOffset* boffset,
+      BinlogStamp* stamp = NULL) const;
 
   // DoCommand related
   slash::RecordMutex mutex_record_;
+  ZPSingleFlight get_flight_;
   pthread_rwlock_t suspend_rw_;  // To suspend others
+  std::shared_ptr<ZPTableQuota> quota_;  // of the whole table
+
+  // Write stall related
+  // Writes are shed before entering db when it stalls,
+  // instead of blocking the threads inside
+  std::atomic<int> stall_level_;
+  std::atomic<uint64_t> stall_check_time_;
+  std::atomic<int> stall_writers_;
+  int GetStallLevel();
+  bool AdmitWrite();
 
   // Recover sync related
   // Be used only in the role of kNodeSlave
@@ -286,6 +358,50 @@ class Partition  {
                                       //set by masters' binlog sender
   std::atomic<int> stuck_recover_sync_flag_;  // how mand cron times
                                               // stuck out of kConnect
+  std::atomic<uint64_t> last_caught_up_time_;  // when master's word that
+                                               // nothing more to sync
+                                               // reached us
+
+  // Follower read related
+  bool FollowerReadable(const Cmd* cmd, const client::CmdRequest &req);
+
+  // Slowlog related
+  void AddSlowlog(const Cmd* cmd, const std::string& key, bool from_sync,
+      uint64_t duration_us, uint64_t queue_us, uint64_t lock_us, bool perf);
+
+  // Slowdown related
+  // As master in SLOWDOWN, writes are paced by how fast slaves catch up
+  std::atomic<uint64_t> catchup_rate_;  // bytes per second of slowest slave
+  std::atomic<uint64_t> slave_lag_;  // bytes behind of slowest slave
+  BinlogOffset last_min_ack_;  // only used by UpdateCatchupRate
+  uint64_t last_rate_time_;
+  slash::Mutex pace_mu_;
+  uint64_t pace_next_us_;  // when the next write could go
+  std::deque<uint64_t> pace_turns_;  // turns taken but not come yet
+  bool PaceWrite(const client::CmdRequest &req, bool can_wait,
+      uint64_t* delay_us);
+  void UpdateCatchupRate();
+
+  // Slave ack related
+  // As master, record how far slaves have applied
+  slash::Mutex slave_ack_mu_;
+  std::map<Node, BinlogOffset> slave_acks_;
+  std::map<Node, BinlogStamp> slave_stamps_;  // only from stamped binlog
+  struct AckWaiter {
+    BinlogOffset target;
+    int num;
+    uint64_t deadline_us;
+    std::set<Node> slaves;  // slaves when the wait begins
+    AckWaitDone done;
+    int acked;  // counted when taken out
+  };
+  std::list<AckWaiter> ack_waiters_;  // protected by slave_ack_mu_
+  int CountSlaveAck(const std::set<Node>& slaves, const BinlogOffset& target);
+  // Take out the waiters which are done, call them after unlock
+  void TakeAckWaiters(bool expire_all, std::vector<AckWaiter>* done);
+  // As slave, whether an ack to master has been scheduled
+  std::atomic<bool> ack_pending_;
+  void ScheduleBinlogAck(uint64_t delay = kBinlogAckDelay);
 
   // BGSave related
   slash::Mutex bgsave_protector_;
@@ -337,6 +453,7 @@ class Partition  {
   // state_rw_      >       db_sync_protector_
   // state_rw_      >       purged_index_rw_
   // state_rw_      >       fallback_rw_
+  // state_rw_      >       slave_ack_mu_
 
   Partition(const Partition&);
   void operator=(const Partition&);
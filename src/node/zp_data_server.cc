@@ -30,9 +30,14 @@
 ZPDataServer::ZPDataServer()
   : table_count_(0),
   should_exit_(false),
+  should_reload_conf_(false),
   meta_port_(0),
   meta_epoch_(-1),
-  should_pull_meta_(false) {
+  should_pull_meta_(false),
+  row_cache_(NULL),
+  slowlog_(kSlowlogMaxLen),
+  trace_exporter_(NULL),
+  metrics_server_(NULL) {
     pthread_rwlock_init(&meta_state_rw_, NULL);
     pthread_rwlockattr_t attr;
     pthread_rwlockattr_init(&attr);
@@ -56,6 +61,7 @@ ZPDataServer::ZPDataServer()
     LOG(INFO) << "ZPNodeServer init thread";
     zp_metacmd_bgworker_ = new ZPMetacmdBGWorker();
     zp_trysync_thread_ = new ZPTrySyncThread();
+    zp_binlog_ack_thread_ = new ZPBinlogAckThread();
 
     // Binlog receive
     for (int j = 0; j < g_zp_conf->sync_recv_thread_num(); j++) {
@@ -95,10 +101,33 @@ ZPDataServer::ZPDataServer()
     zp_dispatch_thread_->set_keepalive_timeout(kKeepAlive);
     zp_dispatch_thread_->set_thread_name("ZPDataDispatch");
 
+    // Execute commands out of dispatch threads
+    data_executor_ = NULL;
+    if (g_zp_conf->data_exec_thread_num() > 0) {
+      data_executor_ = new ZPDataExecutor(g_zp_conf->data_exec_thread_num());
+    }
+
     // Ping
     zp_ping_thread_ = new ZPPingThread();
 
     InitDBOptions();
+
+    // Row cache
+    if (g_zp_conf->row_cache_size() > 0) {
+      row_cache_ = new ZPRowCache(
+          static_cast<size_t>(g_zp_conf->row_cache_size()) * 1024 * 1024);
+      LOG(INFO) << "Row cache enabled, capacity: "
+        << g_zp_conf->row_cache_size() << "MB";
+    }
+
+    // Sampled traces
+    trace_exporter_ = new ZPTraceExporter(g_zp_conf->log_path() + kTraceFile);
+
+    // Metrics for prometheus
+    if (g_zp_conf->metrics_port() > 0) {
+      metrics_server_ = new ZPMetricsServer(g_zp_conf->metrics_port(),
+          [this](ZPMetrics* metrics) { CollectMetrics(metrics); });
+    }
     LOG(INFO) << "ZPDataServer constructed";
   }
 
@@ -109,6 +138,7 @@ ZPDataServer::~ZPDataServer() {
   // 2, binlog reciever should before recieve bgworker
   // 3, binlog send thread should before binlog send pool
   delete zp_ping_thread_;
+  delete metrics_server_;
 
   // We call StopThread first
   zp_dispatch_thread_->StopThread();
@@ -116,6 +146,9 @@ ZPDataServer::~ZPDataServer() {
   delete client_factory_;
   delete client_handle_;
   LOG(INFO) << "Dispatch thread exit!";
+  delete data_executor_;
+  // WAIT left are answered when partitions exit
+  ackwait_thread_.StopThread();
 
   auto it = binlog_send_workers_.begin();
   for (; it != binlog_send_workers_.end(); ++it) {
@@ -134,6 +167,10 @@ ZPDataServer::~ZPDataServer() {
   delete sync_factory_;
   delete sync_handle_;
 
+  // No command could touch row cache from now on
+  delete row_cache_;
+  delete trace_exporter_;
+
   // Statistic result
   for (int i = 0; i < 2; i++) {
     slash::MutexLock l(&(stats_[i].mu));
@@ -143,6 +180,7 @@ ZPDataServer::~ZPDataServer() {
   }
 
   delete zp_trysync_thread_;
+  delete zp_binlog_ack_thread_;
   delete zp_metacmd_bgworker_;
 
   LOG(INFO) << " All Tables exit!!!";
@@ -194,6 +232,32 @@ void ZPDataServer::InitDBOptions() {
 }
 
 Status ZPDataServer::Start() {
+  Status s = trace_exporter_->Start();
+  if (!s.ok()) {
+    // Traces are discarded
+    LOG(WARNING) << "Trace exporter start failed, " << s.ToString();
+  }
+
+  if (metrics_server_ != NULL) {
+    s = metrics_server_->Start();
+    if (!s.ok()) {
+      // Serve without metrics
+      LOG(WARNING) << "Metrics server start failed, " << s.ToString();
+    } else {
+      LOG(INFO) << "Metrics server started on port "
+        << g_zp_conf->metrics_port();
+    }
+  }
+
+  if (data_executor_ != NULL) {
+    Status s = data_executor_->Start();
+    if (!s.ok()) {
+      LOG(FATAL) << "Data executor start failed";
+      return s;
+    }
+    LOG(INFO) << "Data executor started";
+  }
+
   if (pink::RetCode::kSuccess != zp_dispatch_thread_->StartThread()) {
     LOG(FATAL) << "Dispatch thread start failed";
     return Status::Corruption("Dispatch thread start failed!");
@@ -223,13 +287,19 @@ Status ZPDataServer::Start() {
   }
   LOG(INFO) << "Binlog sender thread started";
 
-  auto iter = g_zp_conf->meta_addr().begin();
-  while (iter != g_zp_conf->meta_addr().end()) {
-    LOG(INFO) << "Meta seed is: " << *iter;
-    iter++;
+  for (auto& addr : g_zp_conf->meta_addr()) {
+    LOG(INFO) << "Meta seed is: " << addr;
   }
 
   while (!should_exit_) {
+    if (should_reload_conf_.exchange(false)) {
+      if (g_zp_conf->Reload() != 0) {
+        LOG(WARNING) << "Reload conf failed, keep the current one";
+      } else {
+        LOG(INFO) << "Conf reloaded";
+        g_zp_conf->Dump();
+      }
+    }
     DoTimingTask();
     int sleep_count = kNodeCronWaitCount;
     while (!should_exit_ && sleep_count-- > 0) {
@@ -376,6 +446,13 @@ void ZPDataServer::BGPurgeTaskSchedule(void (*function)(void*), void* arg) {
   bgpurge_thread_.Schedule(function, arg);
 }
 
+void ZPDataServer::AckWaitTimerSchedule(uint64_t delay_ms,
+    void (*function)(void*), void* arg) {
+  slash::MutexLock l(&ackwait_thread_protector_);
+  ackwait_thread_.StartThread();
+  ackwait_thread_.DelaySchedule(delay_ms, function, arg);
+}
+
 // Add Task, remove first if already exist
 // Return Status::InvalidArgument means the filenum and offset is Invalid
 Status ZPDataServer::AddBinlogSendTask(const std::string &table,
@@ -415,6 +492,11 @@ void ZPDataServer::AddMetacmdTask() {
   zp_metacmd_bgworker_->AddTask();
 }
 
+void ZPDataServer::AddBinlogAckTask(const std::string& table,
+    int partition_id, uint64_t delay) {
+  zp_binlog_ack_thread_->AckTaskSchedule(table, partition_id, delay);
+}
+
 // Here, we dispatch task base on its partition id
 // So that the task within same partition will be located on same thread
 // So there could be no lock in DoBinlogReceiveTask to keep binlogs order
@@ -459,9 +541,34 @@ void ZPDataServer::PlusQueryStat(const StatType type, const std::string &table)
   }
 }
 
+void ZPDataServer::PlusExpiredStat(const StatType type,
+    const std::string &table) {
+  slash::MutexLock l(&(stats_[type].mu));
+  if (table.empty()) {
+    stats_[type].other_stat.expired++;
+  } else {
+    Statistic* pstat = nullptr;
+    auto it = stats_[type].table_stats.find(table);
+    if (it == stats_[type].table_stats.end()) {
+      pstat = new Statistic;
+      pstat->table_name = table;
+      stats_[type].table_stats[table] = pstat;
+    } else {
+      pstat = it->second;
+    }
+    assert(pstat != nullptr);
+    pstat->expired++;
+  }
+}
+
 void ZPDataServer::PlusLatencyStat(
     const StatType type, const std::string &table,
-    CmdType cmd_type, size_t latency_ms) {
+    CmdType cmd_type, uint64_t latency_us) {
+  size_t latency_ms = latency_us / 1000;
+  int bucket = 0;
+  while (bucket < kLatencyBucketNum && latency_us > kLatencyBuckets[bucket]) {
+    bucket++;
+  }
   slash::MutexLock l(&(stats_[type].mu));
   if (!table.empty()) {
     Statistic* pstat = nullptr;
@@ -486,6 +593,8 @@ void ZPDataServer::PlusLatencyStat(
         pstat->read_avg_latency =
           (pstat->read_avg_latency * (pstat->read_queries - 1) + latency_ms)
           / (pstat->read_queries);
+        pstat->read_latency_hist[bucket]++;
+        pstat->read_latency_sum += latency_us;
         break;
       case kSetCmd:
       case kDelCmd:
@@ -497,6 +606,8 @@ void ZPDataServer::PlusLatencyStat(
         pstat->write_avg_latency =
           (pstat->write_avg_latency * (pstat->write_queries - 1) + latency_ms)
           / (pstat->write_queries);
+        pstat->write_latency_hist[bucket]++;
+        pstat->write_latency_sum += latency_us;
         break;
       default:
         break;
@@ -618,16 +729,110 @@ bool ZPDataServer::GetServerInfo(client::CmdResponse_InfoServer* info_server) {
   }
 
   info_server->set_meta_renewing(ShouldPullMeta());
+
+  if (data_executor_ != NULL) {
+    ZPDataExecutor::QueueStat qstat;
+    for (int i = kExecPrior; i <= kExecNormal; i++) {
+      data_executor_->GetQueueStat(static_cast<ExecClass>(i), &qstat);
+      client::CmdResponse_InfoServer_ExecQueue* queue =
+        info_server->add_exec_queues();
+      queue->set_name(ExecClassMsg[i]);
+      queue->set_pending(qstat.pending);
+      queue->set_tasks(qstat.tasks);
+      queue->set_avg_delay_us(qstat.avg_delay_us);
+      queue->set_max_delay_us(qstat.max_delay_us);
+    }
+  }
   return true;
 }
 
+void ZPDataServer::CollectMetrics(ZPMetrics* metrics) {
+  metrics->Declare("zp_meta_epoch", "gauge", "Meta epoch known by node");
+  metrics->Add("zp_meta_epoch", {}, meta_epoch());
+
+  // Command statistic of each table from client and sync
+  metrics->Declare("zp_queries_total", "counter", "Commands executed");
+  metrics->Declare("zp_qps", "gauge", "Commands per second");
+  metrics->Declare("zp_expired_total", "counter",
+      "Commands dropped for deadline exceeded");
+  metrics->Declare("zp_command_latency_microseconds", "histogram",
+      "Command latency");
+  static const std::string kSourceMsg[] = {"client", "sync"};
+  std::set<std::string> table_names;
+  GetAllTableName(&table_names);
+  for (int type = 0; type < 2; type++) {
+    for (auto& name : table_names) {
+      Statistic stat;
+      if (!GetStat(static_cast<StatType>(type), name, &stat)) {
+        continue;
+      }
+      ZPMetrics::Labels labels = {
+        {"table", name},
+        {"source", kSourceMsg[type]}
+      };
+      metrics->Add("zp_queries_total", labels, stat.querys);
+      metrics->Add("zp_qps", labels, stat.last_qps);
+      metrics->Add("zp_expired_total", labels, stat.expired);
+      labels.push_back(std::make_pair("op", "read"));
+      metrics->AddHistogram("zp_command_latency_microseconds", labels,
+          kLatencyBuckets, stat.read_latency_hist, kLatencyBucketNum,
+          stat.read_latency_sum);
+      labels.back().second = "write";
+      metrics->AddHistogram("zp_command_latency_microseconds", labels,
+          kLatencyBuckets, stat.write_latency_hist, kLatencyBucketNum,
+          stat.write_latency_sum);
+    }
+  }
+
+  if (data_executor_ != NULL) {
+    metrics->Declare("zp_exec_queue_pending", "gauge",
+        "Commands waiting in executor queue");
+    metrics->Declare("zp_exec_queue_avg_delay_microseconds", "gauge",
+        "Average queueing delay in last period");
+    metrics->Declare("zp_exec_queue_max_delay_microseconds", "gauge",
+        "Max queueing delay in last period");
+    ZPDataExecutor::QueueStat qstat;
+    for (int i = kExecPrior; i <= kExecNormal; i++) {
+      data_executor_->GetQueueStat(static_cast<ExecClass>(i), &qstat);
+      ZPMetrics::Labels labels = {{"queue", ExecClassMsg[i]}};
+      metrics->Add("zp_exec_queue_pending", labels, qstat.pending);
+      metrics->Add("zp_exec_queue_avg_delay_microseconds", labels,
+          qstat.avg_delay_us);
+      metrics->Add("zp_exec_queue_max_delay_microseconds", labels,
+          qstat.max_delay_us);
+    }
+  }
+
+  if (row_cache_ != NULL) {
+    metrics->Declare("zp_row_cache_capacity_bytes", "gauge",
+        "Memory budget of row cache");
+    metrics->Declare("zp_row_cache_usage_bytes", "gauge",
+        "Memory used by row cache");
+    metrics->Declare("zp_row_cache_hits_total", "counter",
+        "GETs served by row cache");
+    metrics->Declare("zp_row_cache_misses_total", "counter",
+        "GETs missed row cache");
+    ZPRowCache::Stat cstat;
+    row_cache_->GetStat(&cstat);
+    metrics->Add("zp_row_cache_capacity_bytes", {}, cstat.capacity);
+    metrics->Add("zp_row_cache_usage_bytes", {}, cstat.usage);
+    metrics->Add("zp_row_cache_hits_total", {}, cstat.hits);
+    metrics->Add("zp_row_cache_misses_total", {}, cstat.misses);
+  }
+
+  slash::RWLock l(&table_rw_, false);
+  for (auto& table : tables_) {
+    table.second->CollectMetrics(metrics);
+  }
+}
+
 void ZPDataServer::InitClientCmdTable() {
   // SetCmd
   Cmd* setptr = new SetCmd(kCmdFlagsKv | kCmdFlagsWrite);
   cmds_.insert(std::pair<int, Cmd*>(
         static_cast<int>(client::Type::SET), setptr));
   // GetCmd
-  Cmd* getptr = new GetCmd(kCmdFlagsKv | kCmdFlagsRead);
+  Cmd* getptr = new GetCmd(kCmdFlagsKv | kCmdFlagsRead | kCmdFlagsPrior);
   cmds_.insert(std::pair<int, Cmd*>(
         static_cast<int>(client::Type::GET), getptr));
   // DelCmd
@@ -636,24 +841,33 @@ void ZPDataServer::InitClientCmdTable() {
         static_cast<int>(client::Type::DEL), delptr));
   // One InfoCmd handle many type queries;
   Cmd* infostatsptr = new InfoCmd(
-      kCmdFlagsAdmin | kCmdFlagsRead | kCmdFlagsMultiPartition);
+      kCmdFlagsAdmin | kCmdFlagsRead | kCmdFlagsMultiPartition
+      | kCmdFlagsPrior);
   cmds_.insert(std::pair<int, Cmd*>(
         static_cast<int>(client::Type::INFOSTATS), infostatsptr));
   Cmd* infocapacityptr = new InfoCmd(
-      kCmdFlagsAdmin | kCmdFlagsRead | kCmdFlagsMultiPartition);
+      kCmdFlagsAdmin | kCmdFlagsRead | kCmdFlagsMultiPartition
+      | kCmdFlagsPrior);
   cmds_.insert(std::pair<int, Cmd*>(
         static_cast<int>(client::Type::INFOCAPACITY), infocapacityptr));
   Cmd* inforepl = new InfoCmd(
-      kCmdFlagsAdmin | kCmdFlagsRead | kCmdFlagsMultiPartition);
+      kCmdFlagsAdmin | kCmdFlagsRead | kCmdFlagsMultiPartition
+      | kCmdFlagsPrior);
   cmds_.insert(std::pair<int, Cmd*>(
         static_cast<int>(client::Type::INFOREPL), inforepl));
   Cmd* infoserver = new InfoCmd(
-      kCmdFlagsAdmin | kCmdFlagsRead | kCmdFlagsMultiPartition);
+      kCmdFlagsAdmin | kCmdFlagsRead | kCmdFlagsMultiPartition
+      | kCmdFlagsPrior);
   cmds_.insert(std::pair<int, Cmd*>(
         static_cast<int>(client::Type::INFOSERVER), infoserver));
+  Cmd* infoslowlog = new InfoCmd(
+      kCmdFlagsAdmin | kCmdFlagsRead | kCmdFlagsMultiPartition
+      | kCmdFlagsPrior);
+  cmds_.insert(std::pair<int, Cmd*>(
+        static_cast<int>(client::Type::INFOSLOWLOG), infoslowlog));
   // SyncCmd
   Cmd* syncptr = new SyncCmd(
-      kCmdFlagsAdmin | kCmdFlagsRead | kCmdFlagsSuspend);
+      kCmdFlagsAdmin | kCmdFlagsRead | kCmdFlagsSuspend | kCmdFlagsPrior);
   cmds_.insert(std::pair<int, Cmd*>(
         static_cast<int>(client::Type::SYNC), syncptr));
   // MgetCmd
@@ -663,9 +877,20 @@ void ZPDataServer::InitClientCmdTable() {
         static_cast<int>(client::Type::MGET), mgetptr));
   // FlushDBCmd
   Cmd* flushdbptr = new FlushDBCmd(
-      kCmdFlagsAdmin | kCmdFlagsWrite | kCmdFlagsSuspend);
+      kCmdFlagsAdmin | kCmdFlagsWrite | kCmdFlagsSuspend | kCmdFlagsPrior);
   cmds_.insert(std::pair<int, Cmd*>(
         static_cast<int>(client::Type::FLUSHDB), flushdbptr));
+  // WaitCmd
+  Cmd* waitptr = new WaitCmd(
+      kCmdFlagsKv | kCmdFlagsRead | kCmdFlagsMultiPartition);
+  cmds_.insert(std::pair<int, Cmd*>(
+        static_cast<int>(client::Type::WAIT), waitptr));
+  // ConfigCmd
+  Cmd* configptr = new ConfigCmd(
+      kCmdFlagsAdmin | kCmdFlagsWrite | kCmdFlagsMultiPartition
+      | kCmdFlagsPrior);
+  cmds_.insert(std::pair<int, Cmd*>(
+        static_cast<int>(client::Type::CONFIG), configptr));
 }
 
 void ZPDataServer::DoTimingTask() {
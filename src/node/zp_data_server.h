@@ -33,15 +33,21 @@
 #include "include/zp_const.h"
 #include "include/zp_binlog.h"
 #include "include/zp_util.h"
+#include "include/zp_metrics.h"
 #include "src/node/zp_data_entity.h"
 #include "src/node/zp_data_command.h"
 #include "src/node/zp_metacmd_bgworker.h"
 #include "src/node/zp_ping_thread.h"
 #include "src/node/zp_trysync_thread.h"
+#include "src/node/zp_binlog_ack_thread.h"
 #include "src/node/zp_binlog_sender.h"
 #include "src/node/zp_binlog_receive_bgworker.h"
 #include "src/node/zp_data_table.h"
 #include "src/node/zp_data_partition.h"
+#include "src/node/zp_row_cache.h"
+#include "src/node/zp_data_executor.h"
+#include "src/node/zp_slowlog.h"
+#include "src/node/zp_trace.h"
 
 using slash::Status;
 
@@ -101,10 +107,33 @@ class ZPDataServer  {
     return binlog_send_workers_.size();
   }
 
+  // NULL if row cache is disabled
+  ZPRowCache* row_cache() {
+    return row_cache_;
+  }
+
+  // NULL if commands are executed in dispatch threads
+  ZPDataExecutor* data_executor() {
+    return data_executor_;
+  }
+
+  ZPSlowlog* slowlog() {
+    return &slowlog_;
+  }
+
+  ZPTraceExporter* trace_exporter() {
+    return trace_exporter_;
+  }
+
   void Exit() {
     should_exit_ = true;
   }
 
+  // Reload hot config items in cron, safe in signal handler
+  void ReloadConf() {
+    should_reload_conf_ = true;
+  }
+
   // Meta related
   bool ShouldJoinMeta();
   void MetaConnected();
@@ -143,9 +172,13 @@ class ZPDataServer  {
   // Backgroud thread
   void BGSaveTaskSchedule(void (*function)(void*), void* arg);
   void BGPurgeTaskSchedule(void (*function)(void*), void* arg);
+  void AckWaitTimerSchedule(uint64_t delay_ms, void (*function)(void*),
+      void* arg);
   void AddSyncTask(const std::string& table, int partition_id,
       uint64_t delay = 0);
   void AddMetacmdTask();
+  void AddBinlogAckTask(const std::string& table, int partition_id,
+      uint64_t delay = 0);
   Status AddBinlogSendTask(const std::string &table, int parititon_id,
       const std::string& binlog_filename, const Node& node, int32_t filenum,
       int64_t offset);
@@ -164,9 +197,10 @@ class ZPDataServer  {
 
   // Statistic related
   void PlusQueryStat(const StatType type, const std::string &table);
+  void PlusExpiredStat(const StatType type, const std::string &table);
   void PlusLatencyStat(
       const StatType type, const std::string &table,
-      CmdType cmd_type, size_t latency_ms);
+      CmdType cmd_type, uint64_t latency_us);
   void ResetLastStat(const StatType type);
   bool GetTotalStat(const StatType type, Statistic* stat);
 
@@ -178,6 +212,7 @@ class ZPDataServer  {
   bool GetTableReplInfo(const std::string& table_name,
       std::unordered_map<std::string, client::CmdResponse_InfoRepl>* repls);
   bool GetServerInfo(client::CmdResponse_InfoServer* info_server);
+  void CollectMetrics(ZPMetrics* metrics);
 
  private:
   slash::Mutex server_mutex_;
@@ -198,6 +233,7 @@ class ZPDataServer  {
   // Server related
   ZPMetacmdBGWorker* zp_metacmd_bgworker_;
   ZPTrySyncThread* zp_trysync_thread_;
+  ZPBinlogAckThread* zp_binlog_ack_thread_;
 
   std::vector<ZPBinlogReceiveBgWorker*> zp_binlog_receive_bgworkers_;
   pink::ConnFactory* sync_factory_;
@@ -207,9 +243,11 @@ class ZPDataServer  {
   pink::ConnFactory* client_factory_;
   pink::ServerHandle* client_handle_;
   pink::ServerThread* zp_dispatch_thread_;
+  ZPDataExecutor* data_executor_;
   ZPPingThread* zp_ping_thread_;
 
   std::atomic<bool> should_exit_;
+  std::atomic<bool> should_reload_conf_;
 
   // Meta State related
   pthread_rwlock_t meta_state_rw_;
@@ -229,6 +267,8 @@ class ZPDataServer  {
   pink::BGThread bgsave_thread_;
   slash::Mutex bgpurge_thread_protector_;
   pink::BGThread bgpurge_thread_;
+  slash::Mutex ackwait_thread_protector_;
+  pink::BGThread ackwait_thread_;  // expire parked WAIT commands
   void DoTimingTask();
 
   // Statistic related
@@ -249,6 +289,11 @@ class ZPDataServer  {
 
   rocksdb::Options db_options_;
   void InitDBOptions();
+
+  ZPRowCache* row_cache_;
+  ZPSlowlog slowlog_;
+  ZPTraceExporter* trace_exporter_;
+  ZPMetricsServer* metrics_server_;  // NULL if metrics_port is 0
 };
 
 #endif  // SRC_NODE_ZP_DATA_SERVER_H_
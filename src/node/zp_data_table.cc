@@ -39,7 +39,8 @@ Table::Table(const std::string& table_name, const std::string &log_path,
   log_path_(log_path),
   data_path_(data_path),
   trash_path_(trash_path),
-  partition_cnt_(0) {
+  partition_cnt_(0),
+  quota_(new ZPTableQuota()) {
   if (log_path_.back() != '/') {
     log_path_.push_back('/');
   }
@@ -109,7 +110,8 @@ bool Table::UpdateOrAddPartition(const int partition_id,
 
   // New Partition
   std::shared_ptr<Partition> partition = NewPartition(table_name_,
-      log_path_, data_path_, trash_path_, partition_id, master, slaves);
+      log_path_, data_path_, trash_path_, partition_id, master, slaves,
+      quota_);
   assert(partition != NULL);
 
   partition->Update(ZPMeta::PState::ACTIVE, master, slaves);
@@ -142,6 +144,7 @@ void Table::Dump() {
   slash::RWLock l(&partition_rw_, false);
   LOG(INFO) << "=========================";
   LOG(INFO) << "    Table : " << table_name_;
+  LOG(INFO) << "    Throttled : " << quota_->throttled();
   for (auto iter = partitions_.begin(); iter != partitions_.end(); iter++) {
     iter->second->Dump();
   }
@@ -183,6 +186,17 @@ void Table::GetCapacity(Statistic *stat) {
   stat->Dump();
 }
 
+void Table::CollectMetrics(ZPMetrics* metrics) {
+  metrics->Declare("zp_quota_throttled_total", "counter",
+      "Commands refused by table quota");
+  metrics->Add("zp_quota_throttled_total", {{"table", table_name_}},
+      quota_->throttled());
+  slash::RWLock l(&partition_rw_, false);
+  for (auto& p : partitions_) {
+    p.second->CollectMetrics(metrics);
+  }
+}
+
 void Table::GetReplInfo(client::CmdResponse_InfoRepl* repl_info) {
   slash::RWLock l(&partition_rw_, false);
   repl_info->set_table_name(table_name_);
@@ -25,6 +25,7 @@
 #include "src/meta/zp_meta.pb.h"
 #include "src/node/client.pb.h"
 #include "src/node/zp_data_entity.h"
+#include "src/node/zp_table_quota.h"
 
 class Table;
 class Partition;
@@ -44,6 +45,9 @@ class Table  {
   }
 
   bool SetPartitionCount(int count);
+  void UpdateQuota(const ZPMeta::TableQuota& quota) {
+    quota_->Update(quota);
+  }
   std::shared_ptr<Partition> GetPartition(const std::string &key);
   std::shared_ptr<Partition> GetPartitionById(const int partition_id);
   bool UpdateOrAddPartition(int partition_id, ZPMeta::PState state,
@@ -58,6 +62,7 @@ class Table  {
   void DumpPartitionBinlogOffsets(std::map<int, BinlogOffset> *offset);
   void GetCapacity(Statistic *stat);
   void GetReplInfo(client::CmdResponse_InfoRepl* repl_info);
+  void CollectMetrics(ZPMetrics* metrics);
 
  private:
   std::string table_name_;
@@ -69,6 +74,9 @@ class Table  {
   pthread_rwlock_t partition_rw_;
   std::map<int, std::shared_ptr<Partition>> partitions_;
 
+  // Shared with partitions
+  std::shared_ptr<ZPTableQuota> quota_;
+
   Table(const Table&);
   void operator=(const Table&);
 };
@@ -133,6 +133,7 @@ Status ZPMetacmdBGWorker::ParsePullResponse(
     std::shared_ptr<Table> table
       = zp_data_server->GetOrAddTable(table_info.name());
     assert(table != NULL);
+    table->UpdateQuota(table_info.quota());
 
     int j = 0;
     for (; j < table_info.partitions_size(); j++) {
@@ -22,6 +22,7 @@
 #include "slash/include/env.h"
 #include "src/node/zp_data_server.h"
 #include "include/zp_conf.h"
+#include "include/zp_log.h"
 
 
 ZpConf *g_zp_conf;
@@ -34,7 +35,8 @@ static void GlogInit() {
     slash::CreatePath(g_zp_conf->log_path());
   }
 
-  FLAGS_alsologtostderr = true;
+  // Nowhere to write once daemonized
+  FLAGS_alsologtostderr = !g_zp_conf->daemonize();
 
   FLAGS_log_dir = g_zp_conf->log_path();
   FLAGS_minloglevel = 0;
@@ -43,6 +45,7 @@ static void GlogInit() {
   FLAGS_logbufsecs = 0;
 
   ::google::InitGoogleLogging("zp");
+  ZPLogInit();
 }
 
 
@@ -52,8 +55,14 @@ static void IntSigHandle(const int sig) {
   LOG(INFO) << "data server Exit";
 }
 
+static void HupSigHandle(const int sig) {
+  if (zp_data_server != NULL) {
+    zp_data_server->ReloadConf();
+  }
+}
+
 static void ZPDataSignalSetup() {
-  signal(SIGHUP, SIG_IGN);
+  signal(SIGHUP, &HupSigHandle);
   signal(SIGPIPE, SIG_IGN);
   signal(SIGINT, &IntSigHandle);
   signal(SIGQUIT, &IntSigHandle);
@@ -136,6 +145,7 @@ int main(int argc, char** argv) {
   //  printf ("Exit\n");
   delete zp_data_server;
 
+  ZPLogShutdown();
   ::google::ShutdownGoogleLogging();
   return 0;
 }
@@ -0,0 +1,211 @@
+// Copyright 2017 Qihoo
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http:// www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include "src/node/zp_row_cache.h"
+
+#include <functional>
+
+#include "slash/include/env.h"
+
+// Bits of doorkeeper in every shard
+static const size_t kDoorkeeperBits = 1 << 16;
+// Memory used by an entry besides key and value
+static const size_t kEntryOverhead = 64;
+
+static size_t EntryCharge(const std::string& key, const std::string& value) {
+  // key is stored both in entry and index
+  return 2 * key.size() + value.size() + kEntryOverhead;
+}
+
+uint64_t ZPRowCache::NewSpace() {
+  static std::atomic<uint64_t> space(0);
+  return ++space;
+}
+
+ZPRowCache::ZPRowCache(size_t capacity, int shard_bits)
+  : capacity_(capacity),
+  shard_bits_(shard_bits) {
+    int shard_num = 1 << shard_bits_;
+    for (int i = 0; i < shard_num; i++) {
+      Shard* shard = new Shard();
+      shard->capacity = capacity_ / shard_num;
+      shard->doorkeeper.resize(kDoorkeeperBits, false);
+      shards_.push_back(shard);
+    }
+  }
+
+ZPRowCache::~ZPRowCache() {
+  for (auto shard : shards_) {
+    for (auto entry : shard->slots) {
+      delete entry;
+    }
+    delete shard;
+  }
+}
+
+void ZPRowCache::GetStat(Stat* stat) {
+  *stat = Stat();
+  stat->capacity = capacity_;
+  for (auto shard : shards_) {
+    slash::MutexLock l(&shard->mu);
+    stat->usage += shard->usage;
+    stat->hits += shard->hits;
+    stat->misses += shard->misses;
+  }
+}
+
+bool ZPRowCache::Lookup(const std::string& key, std::string* value,
+    RowCacheTicket* ticket) {
+  size_t hash = std::hash<std::string>()(key);
+  Shard* shard = GetShard(hash);
+  slash::MutexLock l(&shard->mu);
+  auto it = shard->index.find(key);
+  if (it != shard->index.end()) {
+    Entry* entry = shard->slots[it->second];
+    if (entry->expire_us == 0 || entry->expire_us > slash::NowMicros()) {
+      entry->referenced = true;
+      value->assign(entry->value);
+      shard->hits++;
+      return true;
+    }
+    // Expired
+    RemoveSlot(shard, it->second);
+  }
+
+  shard->misses++;
+  ticket->version = shard->version;
+  ticket->admit = PassDoorkeeper(shard, hash);
+  return false;
+}
+
+void ZPRowCache::Insert(const std::string& key, const std::string& value,
+    uint64_t expire_us, const RowCacheTicket& ticket) {
+  size_t charge = EntryCharge(key, value);
+  size_t hash = std::hash<std::string>()(key);
+  Shard* shard = GetShard(hash);
+  slash::MutexLock l(&shard->mu);
+  if (!ticket.admit
+      || ticket.version != shard->version  // Some write happened meanwhile
+      || charge > shard->capacity
+      || shard->index.find(key) != shard->index.end()) {
+    return;
+  }
+
+  while (shard->usage + charge > shard->capacity) {
+    if (!EvictOne(shard)) {
+      return;
+    }
+  }
+
+  Entry* entry = new Entry();
+  entry->key = key;
+  entry->value = value;
+  entry->expire_us = expire_us;
+  entry->referenced = false;
+
+  size_t slot = 0;
+  if (!shard->free_slots.empty()) {
+    slot = shard->free_slots.back();
+    shard->free_slots.pop_back();
+    shard->slots[slot] = entry;
+  } else {
+    slot = shard->slots.size();
+    shard->slots.push_back(entry);
+  }
+  shard->index[key] = slot;
+  shard->usage += charge;
+}
+
+void ZPRowCache::Update(const std::string& key, const std::string& value,
+    uint64_t expire_us) {
+  size_t hash = std::hash<std::string>()(key);
+  Shard* shard = GetShard(hash);
+  slash::MutexLock l(&shard->mu);
+  shard->version++;
+  auto it = shard->index.find(key);
+  if (it == shard->index.end()) {
+    return;
+  }
+  Entry* entry = shard->slots[it->second];
+  size_t old_charge = EntryCharge(entry->key, entry->value);
+  size_t new_charge = EntryCharge(key, value);
+  if (shard->usage - old_charge + new_charge > shard->capacity) {
+    // Not worth to make room for it
+    RemoveSlot(shard, it->second);
+    return;
+  }
+  entry->value = value;
+  entry->expire_us = expire_us;
+  shard->usage = shard->usage - old_charge + new_charge;
+}
+
+void ZPRowCache::Erase(const std::string& key) {
+  size_t hash = std::hash<std::string>()(key);
+  Shard* shard = GetShard(hash);
+  slash::MutexLock l(&shard->mu);
+  shard->version++;
+  auto it = shard->index.find(key);
+  if (it != shard->index.end()) {
+    RemoveSlot(shard, it->second);
+  }
+}
+
+// Required: hold mu of shard
+void ZPRowCache::RemoveSlot(Shard* shard, size_t slot) {
+  Entry* entry = shard->slots[slot];
+  shard->usage -= EntryCharge(entry->key, entry->value);
+  shard->index.erase(entry->key);
+  shard->slots[slot] = NULL;
+  shard->free_slots.push_back(slot);
+  delete entry;
+}
+
+// Required: hold mu of shard
+// Sweep the clock hand, give every referenced entry a second chance
+bool ZPRowCache::EvictOne(Shard* shard) {
+  size_t slot_num = shard->slots.size();
+  if (slot_num == 0) {
+    return false;
+  }
+  for (size_t i = 0; i < 2 * slot_num; i++) {
+    size_t slot = shard->hand;
+    shard->hand = (shard->hand + 1) % slot_num;
+    Entry* entry = shard->slots[slot];
+    if (entry == NULL) {
+      continue;
+    }
+    if (entry->referenced) {
+      entry->referenced = false;
+      continue;
+    }
+    RemoveSlot(shard, slot);
+    return true;
+  }
+  return false;
+}
+
+// Required: hold mu of shard
+// Return true if the key has missed before in current window
+bool ZPRowCache::PassDoorkeeper(Shard* shard, size_t hash) {
+  size_t bit = (hash >> shard_bits_) % kDoorkeeperBits;
+  if (shard->doorkeeper[bit]) {
+    return true;
+  }
+  shard->doorkeeper[bit] = true;
+  if (++shard->door_count > kDoorkeeperBits / 2) {
+    // Start a new window
+    shard->doorkeeper.assign(kDoorkeeperBits, false);
+    shard->door_count = 0;
+  }
+  return false;
+}
@@ -0,0 +1,116 @@
+// Copyright 2017 Qihoo
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http:// www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#ifndef SRC_NODE_ZP_ROW_CACHE_H_
+#define SRC_NODE_ZP_ROW_CACHE_H_
+
+#include <atomic>
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+#include "slash/include/slash_mutex.h"
+
+// Returned by a missed Lookup, and should be passed back to Insert
+// after value has been read from db
+struct RowCacheTicket {
+  uint64_t version;
+  bool admit;
+  RowCacheTicket()
+    : version(0), admit(false) {}
+};
+
+// Node wide row cache in front of db for GET.
+// Keys are sharded by hash, every shard evict with CLOCK under its own
+// memory budget. A key is only admitted on its second miss within the
+// doorkeeper window, so that one-hit keys won't push the hot ones out.
+class ZPRowCache {
+ public:
+  // capacity in bytes
+  explicit ZPRowCache(size_t capacity, int shard_bits = 6);
+  ~ZPRowCache();
+
+  // Return true if key is cached and not expired.
+  // Otherwise ticket is filled for the later Insert
+  bool Lookup(const std::string& key, std::string* value,
+      RowCacheTicket* ticket);
+
+  // Insert value loaded from db, expire_us is 0 for no ttl.
+  // Dropped if the key's shard has been written after ticket is taken,
+  // since the value may be stale already
+  void Insert(const std::string& key, const std::string& value,
+      uint64_t expire_us, const RowCacheTicket& ticket);
+
+  // Write path, should be called after db write succeed
+  // Update refresh the value only if key is cached already
+  void Update(const std::string& key, const std::string& value,
+      uint64_t expire_us);
+  void Erase(const std::string& key);
+
+  struct Stat {
+    size_t capacity;
+    size_t usage;
+    uint64_t hits;
+    uint64_t misses;
+    Stat()
+      : capacity(0), usage(0), hits(0), misses(0) {}
+  };
+  void GetStat(Stat* stat);
+
+  // Every opened db gets a new space, so that entries left by a closed
+  // or replaced db never be seen again, they will be evicted in time
+  static uint64_t NewSpace();
+
+ private:
+  struct Entry {
+    std::string key;
+    std::string value;
+    uint64_t expire_us;
+    bool referenced;
+  };
+
+  struct Shard {
+    slash::Mutex mu;
+    size_t capacity;
+    size_t usage;
+    uint64_t version;  // increased on every write
+    std::unordered_map<std::string, size_t> index;  // key to slot
+    std::vector<Entry*> slots;
+    std::vector<size_t> free_slots;
+    size_t hand;
+    std::vector<bool> doorkeeper;
+    size_t door_count;
+    uint64_t hits;  // counted here rather than shared by all shards
+    uint64_t misses;
+    Shard()
+      : capacity(0), usage(0), version(0), hand(0), door_count(0),
+      hits(0), misses(0) {}
+  };
+
+  size_t capacity_;
+  int shard_bits_;
+  std::vector<Shard*> shards_;
+
+  Shard* GetShard(size_t hash) {
+    return shards_[hash & ((1 << shard_bits_) - 1)];
+  }
+  // Required: hold mu of shard
+  void RemoveSlot(Shard* shard, size_t slot);
+  bool EvictOne(Shard* shard);
+  bool PassDoorkeeper(Shard* shard, size_t hash);
+
+  ZPRowCache(const ZPRowCache&);
+  void operator=(const ZPRowCache&);
+};
+
+#endif  // SRC_NODE_ZP_ROW_CACHE_H_
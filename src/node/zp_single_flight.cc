@@ -0,0 +1,68 @@
+// Copyright 2017 Qihoo
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http:// www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include "src/node/zp_single_flight.h"
+
+rocksdb::Status ZPSingleFlight::Do(const std::string& key,
+    std::string* value, const LoadFunc& load) {
+  std::shared_ptr<Call> call;
+  bool leader = false;
+  {
+    slash::MutexLock l(&mu_);
+    auto it = calls_.find(key);
+    if (it != calls_.end()) {
+      call = it->second;
+      call->waiters++;
+    } else {
+      call = std::make_shared<Call>();
+      calls_[key] = call;
+      leader = true;
+    }
+  }
+
+  if (!leader) {
+    slash::MutexLock l(&call->mu);
+    while (!call->done) {
+      call->cv.Wait();
+    }
+    value->assign(call->value);
+    return call->s;
+  }
+
+  rocksdb::Status s = load(value);
+
+  int waiters = 0;
+  {
+    slash::MutexLock l(&mu_);
+    auto it = calls_.find(key);
+    if (it != calls_.end() && it->second == call) {
+      calls_.erase(it);
+    }
+    // No one could join from now on
+    waiters = call->waiters;
+  }
+
+  slash::MutexLock l(&call->mu);
+  call->s = s;
+  if (waiters > 0) {
+    call->value.assign(*value);
+  }
+  call->done = true;
+  call->cv.SignalAll();
+  return s;
+}
+
+void ZPSingleFlight::Forget(const std::string& key) {
+  slash::MutexLock l(&mu_);
+  calls_.erase(key);
+}
@@ -0,0 +1,60 @@
+// Copyright 2017 Qihoo
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http:// www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#ifndef SRC_NODE_ZP_SINGLE_FLIGHT_H_
+#define SRC_NODE_ZP_SINGLE_FLIGHT_H_
+
+#include <memory>
+#include <string>
+#include <functional>
+#include <unordered_map>
+
+#include "rocksdb/status.h"
+#include "slash/include/slash_mutex.h"
+
+// In-flight table of db lookups.
+// Concurrent lookups of the same key wait on the first one
+// and share its result, instead of hitting db again.
+class ZPSingleFlight {
+ public:
+  typedef std::function<rocksdb::Status(std::string*)> LoadFunc;
+
+  ZPSingleFlight() {}
+
+  rocksdb::Status Do(const std::string& key, std::string* value,
+      const LoadFunc& load);
+
+  // Should be called after the key is written in db, so that lookups
+  // come later won't share the one begin before the write
+  void Forget(const std::string& key);
+
+ private:
+  struct Call {
+    slash::Mutex mu;
+    slash::CondVar cv;
+    bool done;
+    int waiters;  // protected by mu_ of ZPSingleFlight
+    rocksdb::Status s;
+    std::string value;
+    Call()
+      : cv(&mu), done(false), waiters(0) {}
+  };
+
+  slash::Mutex mu_;
+  std::unordered_map<std::string, std::shared_ptr<Call>> calls_;
+
+  ZPSingleFlight(const ZPSingleFlight&);
+  void operator=(const ZPSingleFlight&);
+};
+
+#endif  // SRC_NODE_ZP_SINGLE_FLIGHT_H_
@@ -0,0 +1,116 @@
+// Copyright 2017 Qihoo
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http:// www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include "src/node/zp_slowlog.h"
+
+#include <stdio.h>
+#include <random>
+#include <utility>
+
+#include "rocksdb/perf_context.h"
+#include "rocksdb/perf_level.h"
+#include "rocksdb/iostats_context.h"
+
+#include "include/zp_conf.h"
+
+extern ZpConf* g_zp_conf;
+
+void ZPSlowlog::Add(SlowlogEntry* entry) {
+  slash::MutexLock l(&mu_);
+  entry->id = next_id_++;
+  entries_.push_front(SlowlogEntry());
+  std::swap(entries_.front(), *entry);
+  while (entries_.size() > max_len_) {
+    entries_.pop_back();
+  }
+}
+
+void ZPSlowlog::Get(size_t num, const std::string& table_name,
+    std::vector<SlowlogEntry>* entries) {
+  slash::MutexLock l(&mu_);
+  for (auto& entry : entries_) {
+    if (entries->size() >= num) {
+      break;
+    }
+    if (table_name.empty() || entry.table_name == table_name) {
+      entries->push_back(entry);
+    }
+  }
+}
+
+void ZPSlowlog::Reset() {
+  slash::MutexLock l(&mu_);
+  entries_.clear();
+}
+
+// Negative slowlog_slower_than disables it
+bool ZPSlowlog::Enabled() {
+  return g_zp_conf->slowlog_slower_than() >= 0;
+}
+
+bool ZPSlowlog::SampleTimer() {
+  static thread_local std::mt19937 mt(std::random_device{}());
+  int rate = g_zp_conf->slowlog_perf_sample_rate();
+  return rate > 0 && mt() % rate == 0;
+}
+
+bool ZPSlowlog::BeginPerf() {
+  if (!Enabled()) {
+    return false;
+  }
+  rocksdb::SetPerfLevel(SampleTimer()
+      ? rocksdb::PerfLevel::kEnableTimeExceptForMutex
+      : rocksdb::PerfLevel::kEnableCount);
+  rocksdb::get_perf_context()->Reset();
+  rocksdb::get_iostats_context()->Reset();
+  return true;
+}
+
+void ZPSlowlog::EndPerf(std::string* perf) {
+  bool timed = rocksdb::GetPerfLevel()
+    >= rocksdb::PerfLevel::kEnableTimeExceptForMutex;
+  rocksdb::SetPerfLevel(rocksdb::PerfLevel::kDisable);
+  if (perf == NULL) {
+    return;
+  }
+  const rocksdb::PerfContext* pc = rocksdb::get_perf_context();
+  const rocksdb::IOStatsContext* ic = rocksdb::get_iostats_context();
+  char buf[1024];
+  int len = snprintf(buf, sizeof(buf),
+      "block_read_count: %lu\nblock_read_byte: %lu\n"
+      "block_cache_hit_count: %lu\n"
+      "internal_key_skipped_count: %lu\n"
+      "internal_delete_skipped_count: %lu\n"
+      "io_bytes_read: %lu\n",
+      pc->block_read_count, pc->block_read_byte,
+      pc->block_cache_hit_count,
+      pc->internal_key_skipped_count,
+      pc->internal_delete_skipped_count,
+      ic->bytes_read);
+  if (!timed) {
+    snprintf(buf + len, sizeof(buf) - len, "timers: not sampled");
+  } else {
+    snprintf(buf + len, sizeof(buf) - len,
+        "block_read_time(us): %lu\n"
+        "get_from_memtable_time(us): %lu\n"
+        "get_from_output_files_time(us): %lu\n"
+        "write_wal_time(us): %lu\nwrite_memtable_time(us): %lu\n"
+        "write_delay_time(us): %lu\nio_read_time(us): %lu",
+        pc->block_read_time / 1000,
+        pc->get_from_memtable_time / 1000,
+        pc->get_from_output_files_time / 1000,
+        pc->write_wal_time / 1000, pc->write_memtable_time / 1000,
+        pc->write_delay_time / 1000, ic->read_nanos / 1000);
+  }
+  perf->assign(buf);
+}
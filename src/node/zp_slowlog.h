@@ -0,0 +1,75 @@
+// Copyright 2017 Qihoo
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http:// www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#ifndef SRC_NODE_ZP_SLOWLOG_H_
+#define SRC_NODE_ZP_SLOWLOG_H_
+
+#include <deque>
+#include <string>
+#include <vector>
+
+#include "slash/include/slash_mutex.h"
+
+struct SlowlogEntry {
+  uint64_t id;
+  uint64_t time;  // unix time in seconds
+  std::string cmd;
+  std::string table_name;
+  int partition_id;
+  std::string key;  // at most kSlowlogKeyLen bytes
+  bool from_sync;  // applied from master's binlog
+  uint64_t duration_us;
+  uint64_t queue_us;  // waiting in executor queue
+  uint64_t lock_us;  // waiting for partition and key lock
+  std::string perf;  // breakdown inside db
+
+  SlowlogEntry()
+    : id(0), time(0), partition_id(-1), from_sync(false),
+    duration_us(0), queue_us(0), lock_us(0) {}
+};
+
+// Most recent slow commands of this node
+class ZPSlowlog {
+ public:
+  explicit ZPSlowlog(size_t max_len)
+    : max_len_(max_len), next_id_(0) {}
+
+  void Add(SlowlogEntry* entry);
+  // The newest num entries of table_name, or of all if it's empty,
+  // newest first
+  void Get(size_t num, const std::string& table_name,
+      std::vector<SlowlogEntry>* entries);
+  void Reset();
+
+  // Whether slow commands are kept
+  static bool Enabled();
+  // Start counting db perf of this thread if slow commands are kept,
+  // return false if not started. Counters are cheap and always on,
+  // timers only for one in slowlog_perf_sample_rate commands
+  static bool BeginPerf();
+  // Stop counting, and format what is counted since BeginPerf
+  static void EndPerf(std::string* perf);
+
+ private:
+  static bool SampleTimer();
+
+  slash::Mutex mu_;
+  size_t max_len_;
+  uint64_t next_id_;
+  std::deque<SlowlogEntry> entries_;
+
+  ZPSlowlog(const ZPSlowlog&);
+  void operator=(const ZPSlowlog&);
+};
+
+#endif  // SRC_NODE_ZP_SLOWLOG_H_
@@ -14,7 +14,9 @@
 #include "src/node/zp_sync_conn.h"
 
 #include <glog/logging.h>
+#include "include/zp_log.h"
 #include "src/node/zp_data_server.h"
+#include "src/node/zp_binlog_record.h"
 
 extern ZPDataServer* zp_data_server;
 
@@ -53,18 +55,18 @@ void ZPSyncConn::DebugReceive(const client::CmdRequest &crequest) const {
 
 int ZPSyncConn::DealMessage() {
   if (!zp_data_server->Availible()) {
-    LOG(WARNING) << "Receive Binlog command, but the server is not availible";
+    LOG_LIMITED(WARNING) << "Receive Binlog command, but the server is not availible";
     return -1;
   }
 
   if (!request_.ParseFromArray(rbuf_ + cur_pos_ - header_len_, header_len_)) {
-    LOG(WARNING) << "Receive Binlog command, but parse error";
+    LOG_LIMITED(WARNING) << "Receive Binlog command, but parse error";
     return -1;
   }
 
   // Check request
   if (request_.epoch() < zp_data_server->meta_epoch()) {
-    LOG(WARNING) << "Receive Binlog command with expired epoch:"
+    LOG_LIMITED(WARNING) << "Receive Binlog command with expired epoch:"
       << request_.epoch()
       << ", my current epoch :" << zp_data_server->meta_epoch()
       << ", from: (" << request_.from().ip() << ", "
@@ -76,8 +78,24 @@ int ZPSyncConn::DealMessage() {
   set_is_reply(false);
 
   ZPBinlogReceiveTask *arg = NULL;
-  if (request_.sync_type() == client::SyncType::LEASE) {
-    // Receive a lease renew request
+  if (request_.sync_type() == client::SyncType::ACK) {
+    // Receive applied offset from slave, handle it right here
+    // since it has nothing to do with the binlog order
+    client::BinlogAck back = request_.binlog_ack();
+    std::shared_ptr<Partition> partition =
+      zp_data_server->GetTablePartitionById(back.table_name(),
+          back.partition_id());
+    if (partition != NULL) {
+      partition->DoBinlogAck(
+          Node(request_.from().ip(), request_.from().port()),
+          BinlogOffset(request_.sync_offset().filenum(),
+            request_.sync_offset().offset()),
+          BinlogStamp(request_.stamp().seq(), request_.stamp().time_us()));
+    }
+    return 0;
+  } else if (request_.sync_type() == client::SyncType::LEASE) {
+    // Receive a lease renew request, master was caught up no later
+    // than now, while the lease may wait behind earlier items in queue
     client::SyncLease slease = request_.sync_lease();
     PartitionSyncOption option(
         request_.sync_type(),
@@ -87,7 +105,9 @@ int ZPSyncConn::DealMessage() {
         0, 0);
     arg = new ZPBinlogReceiveTask(
         option,
-        slease.lease());
+        slease.lease(),
+        slease.caught_up(),
+        slash::NowMicros());
   } else if (request_.sync_type() == client::SyncType::SKIP) {
     // Receive a binlog skip request
     client::BinlogSkip bskip = request_.binlog_skip();
@@ -106,7 +126,26 @@ int ZPSyncConn::DealMessage() {
 
   } else if (request_.sync_type() == client::SyncType::CMD) {
     // Receive a cmd request
-    client::CmdRequest crequest = request_.request();
+    client::CmdRequest crequest;
+    if (request_.has_binlog_item()) {
+      // Stamped by master, maybe compressed or compact
+      Slice item(request_.binlog_item().data(),
+          request_.binlog_item().size());
+      BinlogStamp stamp;
+      int flags = 0;
+      DecodeBinlogItem(item, &stamp, &flags);
+      std::string scratch;
+      Slice content;
+      if (!GetBinlogItemContent(item, &stamp, &scratch, &content)
+          || !ParseBinlogContent(content, flags, request_.table_name(),
+            &crequest)) {
+        LOG(ERROR) << "SyncConn receive broken binlog item, from: "
+          << request_.from().ip() << ":" << request_.from().port();
+        return -1;
+      }
+    } else {
+      crequest = request_.request();
+    }
     DebugReceive(crequest);
 
     Cmd* cmd = zp_data_server->CmdGet(static_cast<int>(crequest.type()));
@@ -146,6 +185,10 @@ int ZPSyncConn::DealMessage() {
         slash::IpPortString(request_.from().ip(), request_.from().port()),
         request_.sync_offset().filenum(),
         request_.sync_offset().offset());
+    if (request_.has_stamp()) {
+      option.stamp = BinlogStamp(request_.stamp().seq(),
+          request_.stamp().time_us());
+    }
 
     // We need to malloc for args need by binglog_bgworker
     // So that it will not be free after the executing of current function
@@ -154,6 +197,10 @@ int ZPSyncConn::DealMessage() {
         option,
         cmd,
         crequest);
+    if (request_.has_binlog_item()) {
+      // No longer needed here
+      arg->item.swap(*request_.mutable_binlog_item());
+    }
   } else {
     LOG(ERROR) << "Unknow Sync Request Type: "
       << static_cast<int>(request_.sync_type());
@@ -0,0 +1,111 @@
+// Copyright 2017 Qihoo
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http:// www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include "src/node/zp_table_quota.h"
+
+#include <algorithm>
+
+#include "slash/include/env.h"
+
+////// ZPTokenBucket ///// /
+void ZPTokenBucket::SetRate(int64_t rate) {
+  if (rate < 0) {
+    rate = 0;
+  }
+  if (rate == rate_) {
+    return;
+  }
+  last_us_ = slash::NowMicros();
+  tokens_ = rate;
+  rate_ = rate;
+}
+
+void ZPTokenBucket::Refill() {
+  int64_t rate = rate_;
+  uint64_t now = slash::NowMicros();
+  uint64_t last = last_us_;
+  if (rate <= 0 || now <= last) {
+    return;
+  }
+  uint64_t elapsed = std::min(now - last, static_cast<uint64_t>(1000000));
+  int64_t add = elapsed * rate / 1000000;
+  if (add <= 0) {
+    return;
+  }
+
+  // Only the one moves last_us_ forward adds tokens,
+  // the time of fractional token is kept for next refill
+  uint64_t next_last = (add >= rate) ? now : last + add * 1000000 / rate;
+  if (!last_us_.compare_exchange_strong(last, next_last)) {
+    return;
+  }
+  int64_t cur = tokens_;
+  while (!tokens_.compare_exchange_weak(cur, std::min(cur + add, rate))) {
+  }
+}
+
+bool ZPTokenBucket::Ready() {
+  if (rate_ == 0) {
+    return true;
+  }
+  Refill();
+  return tokens_ > 0;
+}
+
+bool ZPTokenBucket::TryTake(int64_t n) {
+  if (rate_ == 0) {
+    return true;
+  }
+  Refill();
+  int64_t cur = tokens_;
+  while (cur > 0) {
+    if (tokens_.compare_exchange_weak(cur, cur - n)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void ZPTokenBucket::Charge(int64_t n) {
+  if (rate_ == 0) {
+    return;
+  }
+  tokens_ -= n;
+}
+
+////// ZPTableQuota ///// /
+void ZPTableQuota::Update(const ZPMeta::TableQuota& quota) {
+  read_ops_.SetRate(quota.read_ops());
+  write_ops_.SetRate(quota.write_ops());
+  read_bytes_.SetRate(quota.read_bytes());
+  write_bytes_.SetRate(quota.write_bytes());
+}
+
+bool ZPTableQuota::Acquire(bool is_write, int64_t bytes) {
+  ZPTokenBucket* ops = is_write ? &write_ops_ : &read_ops_;
+  ZPTokenBucket* flow = is_write ? &write_bytes_ : &read_bytes_;
+  if (!flow->Ready() || !ops->TryTake(1)) {
+    throttled_++;
+    return false;
+  }
+  flow->Charge(bytes);
+  return true;
+}
+
+void ZPTableQuota::Charge(bool is_write, int64_t bytes) {
+  if (is_write) {
+    write_bytes_.Charge(bytes);
+  } else {
+    read_bytes_.Charge(bytes);
+  }
+}
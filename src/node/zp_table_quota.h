@@ -0,0 +1,82 @@
+// Copyright 2017 Qihoo
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http:// www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#ifndef SRC_NODE_ZP_TABLE_QUOTA_H_
+#define SRC_NODE_ZP_TABLE_QUOTA_H_
+
+#include <atomic>
+
+#include "src/meta/zp_meta.pb.h"
+
+// Lock-free token bucket refilled by the elapsed time,
+// which holds at most one second of tokens.
+// Tokens may go below zero when charged by size after the fact,
+// then requests are refused until the debt is paid back.
+class ZPTokenBucket {
+ public:
+  ZPTokenBucket()
+    : rate_(0), tokens_(0), last_us_(0) {}
+
+  // Tokens per second, 0 means unlimited
+  void SetRate(int64_t rate);
+  int64_t rate() const {
+    return rate_;
+  }
+
+  // Whether there is any token left
+  bool Ready();
+  // Take n tokens only if there is any left
+  bool TryTake(int64_t n);
+  // Take n tokens anyway
+  void Charge(int64_t n);
+
+ private:
+  std::atomic<int64_t> rate_;
+  std::atomic<int64_t> tokens_;
+  std::atomic<uint64_t> last_us_;
+  void Refill();
+
+  ZPTokenBucket(const ZPTokenBucket&);
+  void operator=(const ZPTokenBucket&);
+};
+
+// Read and write budgets of one table on this node,
+// shared by all partitions of the table
+class ZPTableQuota {
+ public:
+  ZPTableQuota()
+    : throttled_(0) {}
+
+  void Update(const ZPMeta::TableQuota& quota);
+
+  // Charge a command before execution, false if over limit
+  bool Acquire(bool is_write, int64_t bytes);
+  // Charge bytes only known after execution, such as the value read
+  void Charge(bool is_write, int64_t bytes);
+
+  uint64_t throttled() const {
+    return throttled_;
+  }
+
+ private:
+  ZPTokenBucket read_ops_;
+  ZPTokenBucket write_ops_;
+  ZPTokenBucket read_bytes_;
+  ZPTokenBucket write_bytes_;
+  std::atomic<uint64_t> throttled_;  // refused commands
+
+  ZPTableQuota(const ZPTableQuota&);
+  void operator=(const ZPTableQuota&);
+};
+
+#endif  // SRC_NODE_ZP_TABLE_QUOTA_H_
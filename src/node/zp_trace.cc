@@ -0,0 +1,263 @@
+// Copyright 2017 Qihoo
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http:// www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include "src/node/zp_trace.h"
+
+#include <unistd.h>
+#include <glog/logging.h>
+#include <random>
+
+#include "include/zp_const.h"
+#include "src/node/zp_data_server.h"
+
+extern ZPDataServer* zp_data_server;
+
+static std::mt19937_64& TraceRandom() {
+  static thread_local std::mt19937_64 mt(std::random_device{}());
+  return mt;
+}
+
+static void AppendJsonString(const std::string& str, std::string* out) {
+  out->append("\"");
+  for (char c : str) {
+    if (c == '"' || c == '\\') {
+      out->push_back('\\');
+      out->push_back(c);
+    } else if (static_cast<unsigned char>(c) < 0x20) {
+      char buf[8];
+      snprintf(buf, sizeof(buf), "\\u%04x", c);
+      out->append(buf);
+    } else {
+      out->push_back(c);
+    }
+  }
+  out->append("\"");
+}
+
+// Ids are written to trace file as they are, so only lowercase hex
+// of the OTLP length is taken from outside
+static bool IsValidId(const std::string& id, int bytes) {
+  if (static_cast<int>(id.size()) != bytes * 2) {
+    return false;
+  }
+  for (char c : id) {
+    if (!((c >= '0' && c <= '9') || (c >= 'a' && c <= 'f'))) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// OTLP encodes time and other 64 bit integers as string
+static void AppendJsonNano(uint64_t us, std::string* out) {
+  out->append("\"" + std::to_string(us * 1000) + "\"");
+}
+
+////// ZPTrace ///// /
+std::string ZPTrace::NewId(int bytes) {
+  static const char kHex[] = "0123456789abcdef";
+  std::string id;
+  while (static_cast<int>(id.size()) < bytes * 2) {
+    uint64_t r = TraceRandom()();
+    for (int i = 0; i < 16 && static_cast<int>(id.size()) < bytes * 2; i++) {
+      id.push_back(kHex[r & 0xf]);
+      r >>= 4;
+    }
+  }
+  return id;
+}
+
+void ZPTrace::Sample(client::CmdRequest* request) {
+  if (request->has_trace()) {
+    // Traced by client, or a new trace if its ids are bad
+    client::TraceContext* context = request->mutable_trace();
+    if (!IsValidId(context->trace_id(), 16)
+        || !IsValidId(context->span_id(), 8)) {
+      context->set_trace_id(NewId(16));
+      context->clear_parent_span_id();
+    } else {
+      context->set_parent_span_id(context->span_id());
+    }
+    context->set_span_id(NewId(8));
+    return;
+  }
+  int rate = g_zp_conf->trace_sample_rate();
+  if (rate <= 0 || TraceRandom()() % rate != 0) {
+    return;
+  }
+  client::TraceContext* context = request->mutable_trace();
+  context->set_trace_id(NewId(16));
+  context->set_span_id(NewId(8));
+}
+
+ZPTrace::ZPTrace(const client::TraceContext& context, bool on_slave,
+    const std::string& name)
+  : trace_id_(context.trace_id()),
+  name_(name) {
+    if (on_slave) {
+      span_id_ = NewId(8);
+      parent_span_id_ = context.span_id();
+    } else {
+      span_id_ = context.span_id();
+      parent_span_id_ = context.parent_span_id();
+    }
+    // Context not from Sample, e.g. binlog of an older master
+    if (!IsValidId(trace_id_, 16)) {
+      trace_id_ = NewId(16);
+      parent_span_id_.clear();
+    }
+    if (!IsValidId(span_id_, 8)) {
+      span_id_ = NewId(8);
+    }
+    if (!parent_span_id_.empty() && !IsValidId(parent_span_id_, 8)) {
+      parent_span_id_.clear();
+    }
+  }
+
+void ZPTrace::AddAttr(const std::string& key, const std::string& value) {
+  attrs_.push_back(std::make_pair(key, value));
+}
+
+void ZPTrace::AddSpan(const std::string& name,
+    uint64_t start_us, uint64_t end_us) {
+  Span span;
+  span.name = name;
+  span.span_id = NewId(8);
+  span.start_us = start_us;
+  span.end_us = end_us < start_us ? start_us : end_us;
+  spans_.push_back(span);
+}
+
+void ZPTrace::Finish(uint64_t start_us, uint64_t end_us) {
+  std::string node = g_zp_conf->local_ip() + ":"
+    + std::to_string(g_zp_conf->local_port());
+  std::string line;
+  line.append("{\"resourceSpans\":[{\"resource\":{\"attributes\":["
+      "{\"key\":\"service.name\",\"value\":{\"stringValue\":\"zp-node\"}},"
+      "{\"key\":\"zp.node\",\"value\":{\"stringValue\":");
+  AppendJsonString(node, &line);
+  line.append("}}]},\"scopeSpans\":[{\"scope\":{\"name\":\"zeppelin\"},"
+      "\"spans\":[");
+
+  // Command span
+  line.append("{\"traceId\":\"" + trace_id_ + "\",\"spanId\":\""
+      + span_id_ + "\"");
+  if (!parent_span_id_.empty()) {
+    line.append(",\"parentSpanId\":\"" + parent_span_id_ + "\"");
+  }
+  line.append(",\"name\":");
+  AppendJsonString(name_, &line);
+  line.append(",\"kind\":2,\"startTimeUnixNano\":");  // SERVER
+  AppendJsonNano(start_us, &line);
+  line.append(",\"endTimeUnixNano\":");
+  AppendJsonNano(end_us, &line);
+  line.append(",\"attributes\":[");
+  for (size_t i = 0; i < attrs_.size(); i++) {
+    if (i > 0) {
+      line.append(",");
+    }
+    line.append("{\"key\":");
+    AppendJsonString(attrs_[i].first, &line);
+    line.append(",\"value\":{\"stringValue\":");
+    AppendJsonString(attrs_[i].second, &line);
+    line.append("}}");
+  }
+  line.append("]}");
+
+  // Stages
+  for (auto& span : spans_) {
+    line.append(",{\"traceId\":\"" + trace_id_ + "\",\"spanId\":\""
+        + span.span_id + "\",\"parentSpanId\":\"" + span_id_
+        + "\",\"name\":");
+    AppendJsonString(span.name, &line);
+    line.append(",\"kind\":1,\"startTimeUnixNano\":");  // INTERNAL
+    AppendJsonNano(span.start_us, &line);
+    line.append(",\"endTimeUnixNano\":");
+    AppendJsonNano(span.end_us, &line);
+    line.append("}");
+  }
+  line.append("]}]}]}\n");
+
+  zp_data_server->trace_exporter()->Export(line);
+}
+
+////// ZPTraceExporter ///// /
+ZPTraceExporter::ZPTraceExporter(const std::string& path)
+  : path_(path),
+  file_(NULL),
+  dropped_(0),
+  flush_thread_(NULL) {
+  }
+
+ZPTraceExporter::~ZPTraceExporter() {
+  delete flush_thread_;
+  Flush();
+  if (file_ != NULL) {
+    fclose(file_);
+  }
+}
+
+Status ZPTraceExporter::Start() {
+  file_ = fopen(path_.c_str(), "a");
+  if (file_ == NULL) {
+    return Status::IOError("Open trace file failed", path_);
+  }
+  flush_thread_ = new FlushThread(this);
+  if (pink::RetCode::kSuccess != flush_thread_->StartThread()) {
+    return Status::Corruption("Trace flush thread start failed");
+  }
+  return Status::OK();
+}
+
+void ZPTraceExporter::Export(const std::string& line) {
+  slash::MutexLock l(&mu_);
+  if (file_ == NULL) {
+    return;
+  }
+  if (pending_.size() >= kTraceMaxPending) {
+    dropped_++;
+    return;
+  }
+  pending_.push_back(line);
+}
+
+void ZPTraceExporter::Flush() {
+  std::vector<std::string> lines;
+  size_t dropped = 0;
+  {
+    slash::MutexLock l(&mu_);
+    lines.swap(pending_);
+    std::swap(dropped, dropped_);
+  }
+  if (dropped > 0) {
+    LOG(WARNING) << dropped << " traces dropped for too many pending";
+  }
+  if (lines.empty() || file_ == NULL) {
+    return;
+  }
+  for (auto& line : lines) {
+    fwrite(line.data(), 1, line.size(), file_);
+  }
+  fflush(file_);
+}
+
+void* ZPTraceExporter::FlushThread::ThreadMain() {
+  while (!should_stop()) {
+    exporter_->Flush();
+    int sleep_count = kTraceFlushInterval / 100;
+    while (!should_stop() && sleep_count-- > 0) {
+      usleep(100 * 1000);
+    }
+  }
+  return NULL;
+}
@@ -0,0 +1,106 @@
+// Copyright 2017 Qihoo
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http:// www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#ifndef SRC_NODE_ZP_TRACE_H_
+#define SRC_NODE_ZP_TRACE_H_
+
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include <utility>
+
+#include "pink/include/pink_thread.h"
+#include "slash/include/slash_mutex.h"
+#include "slash/include/slash_status.h"
+
+#include "src/node/client.pb.h"
+
+using slash::Status;
+
+// Spans of one sampled command on this node.
+// The trace context is carried in CmdRequest, so that it goes
+// into binlog and reaches slaves, where apply is traced as a child.
+class ZPTrace {
+ public:
+  // Decide whether a client command is traced. If so, the context in
+  // request is set to the command span on this node, whose parent is
+  // the one from client if any
+  static void Sample(client::CmdRequest* request);
+
+  // As the command span on master, or as a child of it on slave
+  ZPTrace(const client::TraceContext& context, bool on_slave,
+      const std::string& name);
+
+  void AddAttr(const std::string& key, const std::string& value);
+  // Stage inside the command
+  void AddSpan(const std::string& name, uint64_t start_us, uint64_t end_us);
+  // Export all spans
+  void Finish(uint64_t start_us, uint64_t end_us);
+
+ private:
+  struct Span {
+    std::string name;
+    std::string span_id;
+    uint64_t start_us;
+    uint64_t end_us;
+  };
+
+  std::string trace_id_;
+  std::string span_id_;
+  std::string parent_span_id_;
+  std::string name_;
+  std::vector<std::pair<std::string, std::string>> attrs_;
+  std::vector<Span> spans_;
+
+  static std::string NewId(int bytes);
+};
+
+// Write finished traces as OTLP JSON lines to a local file,
+// one ExportTraceServiceRequest each line
+class ZPTraceExporter {
+ public:
+  explicit ZPTraceExporter(const std::string& path);
+  ~ZPTraceExporter();
+
+  Status Start();
+  void Export(const std::string& line);
+
+ private:
+  class FlushThread : public pink::Thread {
+   public:
+    explicit FlushThread(ZPTraceExporter* exporter)
+      : exporter_(exporter) {
+        set_thread_name("ZPTraceFlush");
+      }
+    virtual ~FlushThread() {
+      StopThread();
+    }
+
+   private:
+    ZPTraceExporter* exporter_;
+    virtual void* ThreadMain();
+  };
+
+  std::string path_;
+  FILE* file_;
+  slash::Mutex mu_;
+  std::vector<std::string> pending_;
+  size_t dropped_;  // for too many pending
+  FlushThread* flush_thread_;
+  void Flush();
+
+  ZPTraceExporter(const ZPTraceExporter&);
+  void operator=(const ZPTraceExporter&);
+};
+
+#endif  // SRC_NODE_ZP_TRACE_H_
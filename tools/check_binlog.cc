@@ -0,0 +1,95 @@
+#include <stdio.h>
+#include <iostream>
+#include <string>
+
+#include "slash/include/env.h"
+#include "include/zp_binlog.h"
+
+void print_usage_exit() {
+  std::cout << "Usage:" << std::endl;
+  std::cout << "    ./check_binlog binlog_file [binlog_file ...]" << std::endl;
+  exit(-1);
+}
+
+// Return number of bad records
+int CheckBinlog(const std::string& path) {
+  slash::SequentialFile* queue = NULL;
+  BinlogReader* reader = NULL;
+  slash::Status s = BinlogReader::CreateMapped(path, true, &reader);
+  if (!s.ok()) {
+    // Empty or unmappable, read it sequentially
+    s = slash::NewSequentialFile(path, &queue);
+    if (!s.ok()) {
+      std::cout << "Open " << path << " failed: " << s.ToString() << std::endl;
+      return 1;
+    }
+    reader = new BinlogReader(queue);
+  }
+
+  uint64_t begin_us = slash::NowMicros();
+  uint64_t offset = 0, records = 0, compressed = 0;
+  BinlogStamp first, last;
+  int bad = 0;
+  while (true) {
+    uint64_t size = 0;
+    std::string scratch;
+    Slice item;
+    uint64_t record_offset = offset;
+    s = reader->Consume(&size, &scratch, &item);
+    if (s.IsEndFile()) {
+      break;
+    }
+    if (s.ok()) {
+      records++;
+      BinlogStamp stamp;
+      int flags = 0;
+      DecodeBinlogItem(item, &stamp, &flags);
+      if (flags & kBinlogItemSnappy) {
+        compressed++;
+        std::string uncompressed;
+        Slice content;
+        if (!GetBinlogItemContent(item, &stamp, &uncompressed, &content)) {
+          bad++;
+          std::cout << "  bad compressed item at " << record_offset
+            << std::endl;
+        }
+      }
+      if (stamp.seq > 0) {
+        if (first.seq == 0) {
+          first = stamp;
+        }
+        last = stamp;
+      }
+    } else if (!s.IsIncomplete()) {
+      bad++;
+      std::cout << "  bad record at " << record_offset
+        << ": " << s.ToString() << std::endl;
+      reader->SkipNextBlock(&size);
+    }
+    offset += size;
+  }
+  delete reader;
+  delete queue;
+
+  uint64_t cost_us = slash::NowMicros() - begin_us + 1;
+  std::cout << path << ": " << records << " records, " << offset
+    << " bytes, " << compressed << " compressed, " << bad << " bad, "
+    << offset / cost_us << " MB/s";
+  if (first.seq > 0) {
+    std::cout << ", seq " << first.seq << " ~ " << last.seq;
+  }
+  std::cout << std::endl;
+  return bad;
+}
+
+int main(int argc, char* argv[]) {
+  if (argc < 2) {
+    print_usage_exit();
+  }
+
+  int bad = 0;
+  for (int i = 1; i < argc; i++) {
+    bad += CheckBinlog(argv[i]);
+  }
+  return bad > 0 ? -1 : 0;
+}